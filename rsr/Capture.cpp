@@ -0,0 +1,713 @@
+#include "Capture.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+static const uint32_t TraceMagic = 0x54525352; //RSRT
+static const uint32_t TraceVersion = 2;
+//resource id for a null pointer where one is allowed
+static const uint32_t NoResource = 0xFFFFFFFF;
+
+//segment the calling thread records into while inside a context
+static thread_local FrameCapture::Buffer *t_captureSegment = nullptr;
+
+#pragma region FrameCapture
+
+FrameCapture::FrameCapture(std::string const &file, size_t width, size_t height)
+   :m_file(file), m_width(width), m_height(height), m_resourceCount(0) {
+   m_segments.push_back(std::unique_ptr<Buffer>(new Buffer()));
+   m_mainSegment = m_segments.back().get();
+}
+
+FrameCapture::Buffer &FrameCapture::segment() {
+   return t_captureSegment ? *t_captureSegment : *m_mainSegment;
+}
+
+void FrameCapture::writeBytes(Buffer &b, void const *data, size_t size) {
+   write(b, (uint32_t)size);
+   auto bytes = (byte const*)data;
+   b.insert(b.end(), bytes, bytes + size);
+}
+
+void FrameCapture::writeString(Buffer &b, const char *str) {
+   writeBytes(b, str, strlen(str));
+}
+
+template<typename F>
+uint32_t FrameCapture::resource(void const *key, CaptureResource type, F const &writePayload) {
+   std::lock_guard<std::mutex> lock(m_resourceMutex);
+
+   auto found = m_resourceIDs.find(key);
+   if (found != m_resourceIDs.end()) {
+      return found->second;
+   }
+
+   uint32_t id = m_resourceCount++;
+   m_resourceIDs.insert(std::make_pair(key, id));
+
+   write(m_resources, type);
+   writePayload(m_resources);
+   return id;
+}
+
+uint32_t FrameCapture::string(StringView str) {
+   return resource(str, CaptureResource::String, [&](Buffer &b) {
+      writeString(b, (const char*)str);
+   });
+}
+
+uint32_t FrameCapture::shader(Shader *s) {
+   return resource(s, CaptureResource::Shader, [&](Buffer &b) {
+      writeString(b, ShaderManager::getFile(s));
+      write(b, (int32_t)ShaderManager::getParams(s));
+   });
+}
+
+uint32_t FrameCapture::model(Model *m) {
+   return resource(m, CaptureResource::Model, [&](Buffer &b) {
+      auto desc = ModelManager::describe(m);
+
+      write(b, (uint32_t)desc.vertexSize);
+      write(b, (uint32_t)desc.vertexCount);
+      write(b, (uint32_t)desc.dataType);
+      write(b, (uint32_t)desc.attrCount);
+      for (int i = 0; i < desc.attrCount; ++i) {
+         write(b, (uint32_t)desc.attrs[i]);
+      }
+      writeBytes(b, desc.data, desc.vertexSize * desc.vertexCount);
+      write(b, (uint32_t)desc.indexSize);
+      writeBytes(b, desc.indices, desc.indexSize * desc.indexCount);
+   });
+}
+
+uint32_t FrameCapture::texture(Texture *t) {
+   return resource(t, CaptureResource::Texture, [&](Buffer &b) {
+      auto &request = TextureManager::getRequest(t);
+
+      writeString(b, (const char*)request.path);
+      write(b, (uint32_t)request.repeatType);
+      write(b, (uint32_t)request.filterType);
+   });
+}
+
+uint32_t FrameCapture::cubeMap(CubeMap *cm) {
+   return resource(cm, CaptureResource::CubeMap, [&](Buffer &b) {
+      auto &faces = CubeMapManager::getFaceFiles(cm);
+
+      write(b, (uint32_t)faces.size());
+      for (auto && f : faces) {
+         writeString(b, f.c_str());
+      }
+   });
+}
+
+uint32_t FrameCapture::ubo(UBO *ubo) {
+   return resource(ubo, CaptureResource::UBO, [&](Buffer &b) {
+      write(b, (uint32_t)UBOManager::getSize(ubo));
+   });
+}
+
+uint32_t FrameCapture::renderTarget(RenderTarget *rt) {
+   if (!rt) {
+      return NoResource;
+   }
+
+   return resource(rt, CaptureResource::RenderTarget, [&](Buffer &b) {
+      auto size = RenderTargetManager::getSize(rt);
+
+      write(b, (int32_t)size.x);
+      write(b, (int32_t)size.y);
+      write(b, (uint32_t)RenderTargetManager::getFilter(rt));
+      write(b, (byte)RenderTargetManager::hasDepth(rt));
+   });
+}
+
+FrameCapture::Buffer *FrameCapture::createContext() {
+   m_segments.push_back(std::unique_ptr<Buffer>(new Buffer()));
+   auto ctx = m_segments.back().get();
+
+   m_segments.push_back(std::unique_ptr<Buffer>(new Buffer()));
+   m_mainSegment = m_segments.back().get();
+
+   return ctx;
+}
+
+void FrameCapture::beginContext(Buffer *segment) { t_captureSegment = segment; }
+void FrameCapture::endContext() { t_captureSegment = nullptr; }
+
+bool FrameCapture::save() {
+   FILE *f = fopen(m_file.c_str(), "wb");
+   if (!f) {
+      return false;
+   }
+
+   Buffer header;
+   write(header, TraceMagic);
+   write(header, TraceVersion);
+   write(header, (uint32_t)m_width);
+   write(header, (uint32_t)m_height);
+   write(header, m_resourceCount);
+
+   uint64_t commandSize = 0;
+   for (auto && s : m_segments) {
+      commandSize += s->size();
+   }
+
+   fwrite(header.data(), 1, header.size(), f);
+   fwrite(m_resources.data(), 1, m_resources.size(), f);
+   fwrite(&commandSize, sizeof(commandSize), 1, f);
+   for (auto && s : m_segments) {
+      fwrite(s->data(), 1, s->size(), f);
+   }
+
+   fclose(f);
+   return true;
+}
+
+void FrameCapture::clear(ColorRGBAf const &c) {
+   auto &b = segment();
+   write(b, CaptureOp::Clear);
+   write(b, c);
+}
+void FrameCapture::viewport(Recti const &r) {
+   auto &b = segment();
+   write(b, CaptureOp::Viewport);
+   write(b, r);
+}
+
+void FrameCapture::setRenderTarget(RenderTarget *rt) {
+   uint32_t id = renderTarget(rt);
+   auto &b = segment();
+   write(b, CaptureOp::SetRenderTarget);
+   write(b, id);
+}
+void FrameCapture::bindRenderTarget(RenderTarget *rt, TextureSlot slot) {
+   uint32_t id = renderTarget(rt);
+   auto &b = segment();
+   write(b, CaptureOp::BindRenderTarget);
+   write(b, id);
+   write(b, (uint32_t)slot);
+}
+void FrameCapture::blitRenderTarget(RenderTarget *rt, Recti const &source, Recti const &dest) {
+   uint32_t id = renderTarget(rt);
+   auto &b = segment();
+   write(b, CaptureOp::BlitRenderTarget);
+   write(b, id);
+   write(b, source);
+   write(b, dest);
+}
+
+void FrameCapture::enableDepth(bool enabled) {
+   auto &b = segment();
+   write(b, CaptureOp::EnableDepth);
+   write(b, (byte)enabled);
+}
+void FrameCapture::enableAlphaBlending(bool enabled) {
+   auto &b = segment();
+   write(b, CaptureOp::EnableAlphaBlending);
+   write(b, (byte)enabled);
+}
+void FrameCapture::enableWireframe(bool enabled) {
+   auto &b = segment();
+   write(b, CaptureOp::EnableWireframe);
+   write(b, (byte)enabled);
+}
+void FrameCapture::enableColorWrite(bool enabled) {
+   auto &b = segment();
+   write(b, CaptureOp::EnableColorWrite);
+   write(b, (byte)enabled);
+}
+void FrameCapture::enableDepthWrite(bool enabled) {
+   auto &b = segment();
+   write(b, CaptureOp::EnableDepthWrite);
+   write(b, (byte)enabled);
+}
+
+void FrameCapture::setShader(Shader *s) {
+   uint32_t id = shader(s);
+   auto &b = segment();
+   write(b, CaptureOp::SetShader);
+   write(b, id);
+}
+void FrameCapture::setFloat2(StringView u, Float2 const &value) {
+   uint32_t id = string(u);
+   auto &b = segment();
+   write(b, CaptureOp::SetFloat2);
+   write(b, id);
+   write(b, value);
+}
+void FrameCapture::setMatrix(StringView u, Matrix const &value) {
+   uint32_t id = string(u);
+   auto &b = segment();
+   write(b, CaptureOp::SetMatrix);
+   write(b, id);
+   write(b, value);
+}
+void FrameCapture::setColor(StringView u, ColorRGBAf const &value) {
+   uint32_t id = string(u);
+   auto &b = segment();
+   write(b, CaptureOp::SetColor);
+   write(b, id);
+   write(b, value);
+}
+
+void FrameCapture::setTextureSlot(StringView u, TextureSlot const &value) {
+   uint32_t id = string(u);
+   auto &b = segment();
+   write(b, CaptureOp::SetTextureSlot);
+   write(b, id);
+   write(b, (uint32_t)value);
+}
+void FrameCapture::bindTexture(Texture *t, TextureSlot slot) {
+   uint32_t id = texture(t);
+   auto &b = segment();
+   write(b, CaptureOp::BindTexture);
+   write(b, id);
+   write(b, (uint32_t)slot);
+}
+
+void FrameCapture::setUBOData(UBO *u, size_t offset, size_t size, void *data) {
+   uint32_t id = ubo(u);
+   auto &b = segment();
+   write(b, CaptureOp::SetUBOData);
+   write(b, id);
+   write(b, (uint32_t)offset);
+   writeBytes(b, data, size);
+}
+void FrameCapture::bindUBO(UBO *u, UBOSlot slot) {
+   uint32_t id = ubo(u);
+   auto &b = segment();
+   write(b, CaptureOp::BindUBO);
+   write(b, id);
+   write(b, (uint32_t)slot);
+}
+void FrameCapture::bindCubeMap(CubeMap *cm, TextureSlot slot) {
+   uint32_t id = cubeMap(cm);
+   auto &b = segment();
+   write(b, CaptureOp::BindCubeMap);
+   write(b, id);
+   write(b, (uint32_t)slot);
+}
+
+void FrameCapture::updateModelData(Model *m, void *data, size_t size, size_t vCount) {
+   uint32_t id = model(m);
+   auto &b = segment();
+   write(b, CaptureOp::UpdateModelData);
+   write(b, id);
+   write(b, (uint32_t)size);
+   write(b, (uint32_t)vCount);
+   writeBytes(b, data, size * vCount);
+}
+void FrameCapture::renderModel(Model *m, ModelManager::RenderType type) {
+   uint32_t id = model(m);
+   auto &b = segment();
+   write(b, CaptureOp::RenderModel);
+   write(b, id);
+   write(b, (byte)type);
+}
+void FrameCapture::renderModelInstanced(Model *m, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+   uint32_t id = model(m);
+   auto &b = segment();
+   write(b, CaptureOp::RenderModelInstanced);
+   write(b, id);
+   write(b, (byte)type);
+   writeBytes(b, instances, sizeof(ModelInstance) * count);
+}
+void FrameCapture::renderModelBatch(Model *const *models, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+   std::vector<uint32_t> ids;
+   for (size_t i = 0; i < count; ++i) {
+      ids.push_back(model(models[i]));
+   }
+
+   auto &b = segment();
+   write(b, CaptureOp::RenderModelBatch);
+   write(b, (byte)type);
+   writeBytes(b, ids.data(), sizeof(uint32_t) * count);
+   writeBytes(b, instances, sizeof(ModelInstance) * count);
+}
+
+#pragma endregion
+
+#pragma region FrameReplay
+
+// bounds-checked reads over the loaded file, any overrun flags the reader as failed
+class TraceReader {
+   byte const *m_data;
+   size_t m_size, m_pos;
+   bool m_failed;
+
+public:
+   TraceReader(byte const *data, size_t size, size_t pos = 0)
+      :m_data(data), m_size(size), m_pos(pos), m_failed(false) {}
+
+   size_t pos() const { return m_pos; }
+   bool failed() const { return m_failed; }
+   bool done() const { return m_failed || m_pos >= m_size; }
+
+   void const *bytes(size_t size) {
+      if (m_failed || m_size - m_pos < size) {
+         m_failed = true;
+         return nullptr;
+      }
+
+      auto out = m_data + m_pos;
+      m_pos += size;
+      return out;
+   }
+
+   template<typename T>
+   T read() {
+      T out;
+      auto b = bytes(sizeof(T));
+      if (b) {
+         memcpy(&out, b, sizeof(T));
+      }
+      else {
+         memset(&out, 0, sizeof(T));
+      }
+      return out;
+   }
+
+   //length-prefixed block, returns null on failure
+   void const *block(uint32_t *size) {
+      *size = read<uint32_t>();
+      return bytes(*size);
+   }
+
+   std::string string() {
+      uint32_t size;
+      auto b = (const char*)block(&size);
+      return b ? std::string(b, size) : std::string();
+   }
+};
+
+FrameReplay::FrameReplay() :m_commandsBegin(0), m_commandsEnd(0), m_width(0), m_height(0) {}
+
+FrameReplay::~FrameReplay() {
+   for (auto && r : m_resources) {
+      switch (r.type) {
+      case CaptureResource::Shader: ShaderManager::destroy((Shader*)r.object); break;
+      case CaptureResource::Model: ModelManager::destroy((Model*)r.object); break;
+      case CaptureResource::CubeMap: CubeMapManager::destroy((CubeMap*)r.object); break;
+      case CaptureResource::UBO: UBOManager::destroy((UBO*)r.object); break;
+      case CaptureResource::RenderTarget: RenderTargetManager::destroy((RenderTarget*)r.object); break;
+      default: break; //strings are interned, textures belong to the TextureManager
+      }
+   }
+}
+
+void *FrameReplay::get(uint32_t id, CaptureResource type) const {
+   if (id >= m_resources.size() || m_resources[id].type != type) {
+      return nullptr;
+   }
+   return m_resources[id].object;
+}
+
+bool FrameReplay::load(const char *file) {
+   FILE *f = fopen(file, "rb");
+   if (!f) {
+      return false;
+   }
+
+   fseek(f, 0, SEEK_END);
+   long fSize = ftell(f);
+   fseek(f, 0, SEEK_SET);
+
+   m_file.resize(fSize);
+   size_t readSize = fread(m_file.data(), 1, fSize, f);
+   fclose(f);
+
+   if (readSize != (size_t)fSize) {
+      return false;
+   }
+
+   TraceReader r(m_file.data(), m_file.size());
+   if (r.read<uint32_t>() != TraceMagic || r.read<uint32_t>() != TraceVersion) {
+      return false;
+   }
+
+   m_width = r.read<uint32_t>();
+   m_height = r.read<uint32_t>();
+
+   uint32_t resourceCount = r.read<uint32_t>();
+   for (uint32_t i = 0; i < resourceCount && !r.failed(); ++i) {
+      Resource res = { r.read<CaptureResource>(), nullptr };
+
+      switch (res.type) {
+      case CaptureResource::String:
+         res.object = (void*)internString(r.string().c_str());
+         break;
+      case CaptureResource::Shader: {
+         auto file = r.string();
+         int params = r.read<int32_t>();
+         res.object = ShaderManager::create(file.c_str(), params);
+         break; }
+      case CaptureResource::Model: {
+         uint32_t vertexSize = r.read<uint32_t>();
+         uint32_t vertexCount = r.read<uint32_t>();
+         auto dataType = (ModelManager::DataStreamType)r.read<uint32_t>();
+         uint32_t attrCount = r.read<uint32_t>();
+
+         std::vector<VertexAttribute> attrs;
+         for (uint32_t a = 0; a < attrCount && !r.failed(); ++a) {
+            attrs.push_back((VertexAttribute)r.read<uint32_t>());
+         }
+
+         uint32_t dataSize;
+         auto data = r.block(&dataSize);
+
+         //indices come back as 32 bit, the model picks its own size again
+         uint32_t indexSize = r.read<uint32_t>();
+         uint32_t indexBytes;
+         auto indexData = (byte const*)r.block(&indexBytes);
+         std::vector<uint32_t> indices;
+         bool indicesValid = true;
+         if (indexData && (indexSize == sizeof(uint16_t) || indexSize == sizeof(uint32_t))) {
+            indices.resize(indexBytes / indexSize);
+            for (size_t i = 0; i < indices.size(); ++i) {
+               if (indexSize == sizeof(uint16_t)) {
+                  uint16_t index;
+                  memcpy(&index, indexData + i * indexSize, indexSize);
+                  indices[i] = index;
+               }
+               else {
+                  memcpy(&indices[i], indexData + i * indexSize, indexSize);
+               }
+               indicesValid = indicesValid && indices[i] < vertexCount;
+            }
+         }
+
+         if (data && dataSize == (uint64_t)vertexSize * vertexCount && indicesValid) {
+            res.object = ModelManager::_create((void*)data, vertexSize, vertexCount, attrs.data(), (int)attrs.size(), dataType,
+               indices.data(), indices.size());
+         }
+         break; }
+      case CaptureResource::Texture: {
+         auto path = r.string();
+         auto repeat = (RepeatType)r.read<uint32_t>();
+         auto filter = (FilterType)r.read<uint32_t>();
+         res.object = TextureManager::get(TextureRequest(internString(path.c_str()), repeat, filter));
+         break; }
+      case CaptureResource::CubeMap: {
+         uint32_t faceCount = r.read<uint32_t>();
+         std::vector<std::string> faces;
+         for (uint32_t face = 0; face < faceCount && !r.failed(); ++face) {
+            faces.push_back(r.string());
+         }
+         res.object = CubeMapManager::create(faces);
+         break; }
+      case CaptureResource::UBO:
+         res.object = UBOManager::create(r.read<uint32_t>());
+         break;
+      case CaptureResource::RenderTarget: {
+         Int2 size;
+         size.x = r.read<int32_t>();
+         size.y = r.read<int32_t>();
+         auto filter = (FilterType)r.read<uint32_t>();
+         bool depth = r.read<byte>() != 0;
+         if (size.x > 0 && size.y > 0) {
+            res.object = RenderTargetManager::create(size, filter, depth);
+         }
+         break; }
+      default:
+         return false;
+      }
+
+      if (!res.object) {
+         return false;
+      }
+
+      m_resources.push_back(res);
+   }
+
+   uint64_t commandSize = r.read<uint64_t>();
+   if (r.failed() || m_file.size() - r.pos() < commandSize) {
+      return false;
+   }
+
+   m_commandsBegin = r.pos();
+   m_commandsEnd = r.pos() + (size_t)commandSize;
+   return true;
+}
+
+//the byte written for a RenderType, anything past Points didn't come from a capture
+static bool validRenderType(byte type) {
+   return type <= ModelManager::Points;
+}
+
+size_t FrameReplay::replay(Renderer &rdr) const {
+   TraceReader r(m_file.data(), m_commandsEnd, m_commandsBegin);
+   size_t count = 0;
+
+   //every id, size and enum is checked before it reaches the renderer, a command that fails any of them is skipped
+   while (!r.done()) {
+      auto op = r.read<CaptureOp>();
+
+      switch (op) {
+      case CaptureOp::Clear:
+         rdr.clear(r.read<ColorRGBAf>());
+         break;
+      case CaptureOp::Viewport:
+         rdr.viewport(r.read<Recti>());
+         break;
+      case CaptureOp::SetRenderTarget: {
+         //NoResource is the window
+         auto id = r.read<uint32_t>();
+         auto rt = (RenderTarget*)get(id, CaptureResource::RenderTarget);
+         if (rt || id == NoResource) {
+            rdr.setRenderTarget(rt);
+         }
+         break; }
+      case CaptureOp::BindRenderTarget: {
+         auto rt = (RenderTarget*)get(r.read<uint32_t>(), CaptureResource::RenderTarget);
+         auto slot = r.read<uint32_t>();
+         if (rt) {
+            rdr.bindRenderTarget(rt, slot);
+         }
+         break; }
+      case CaptureOp::BlitRenderTarget: {
+         auto rt = (RenderTarget*)get(r.read<uint32_t>(), CaptureResource::RenderTarget);
+         auto source = r.read<Recti>();
+         auto dest = r.read<Recti>();
+         if (rt) {
+            rdr.blitRenderTarget(rt, source, dest);
+         }
+         break; }
+      case CaptureOp::EnableDepth:
+         rdr.enableDepth(r.read<byte>() != 0);
+         break;
+      case CaptureOp::EnableAlphaBlending:
+         rdr.enableAlphaBlending(r.read<byte>() != 0);
+         break;
+      case CaptureOp::EnableWireframe:
+         rdr.enableWireframe(r.read<byte>() != 0);
+         break;
+      case CaptureOp::EnableColorWrite:
+         rdr.enableColorWrite(r.read<byte>() != 0);
+         break;
+      case CaptureOp::EnableDepthWrite:
+         rdr.enableDepthWrite(r.read<byte>() != 0);
+         break;
+      case CaptureOp::SetShader: {
+         auto s = (Shader*)get(r.read<uint32_t>(), CaptureResource::Shader);
+         if (s) {
+            rdr.setShader(s);
+         }
+         break; }
+      case CaptureOp::SetFloat2: {
+         auto u = (StringView)get(r.read<uint32_t>(), CaptureResource::String);
+         auto value = r.read<Float2>();
+         if (u) {
+            rdr.setFloat2(u, value);
+         }
+         break; }
+      case CaptureOp::SetMatrix: {
+         auto u = (StringView)get(r.read<uint32_t>(), CaptureResource::String);
+         auto value = r.read<Matrix>();
+         if (u) {
+            rdr.setMatrix(u, value);
+         }
+         break; }
+      case CaptureOp::SetColor: {
+         auto u = (StringView)get(r.read<uint32_t>(), CaptureResource::String);
+         auto value = r.read<ColorRGBAf>();
+         if (u) {
+            rdr.setColor(u, value);
+         }
+         break; }
+      case CaptureOp::SetTextureSlot: {
+         auto u = (StringView)get(r.read<uint32_t>(), CaptureResource::String);
+         auto slot = r.read<uint32_t>();
+         if (u) {
+            rdr.setTextureSlot(u, slot);
+         }
+         break; }
+      case CaptureOp::BindTexture: {
+         auto t = (Texture*)get(r.read<uint32_t>(), CaptureResource::Texture);
+         auto slot = r.read<uint32_t>();
+         if (t) {
+            rdr.bindTexture(t, slot);
+         }
+         break; }
+      case CaptureOp::SetUBOData: {
+         auto ubo = (UBO*)get(r.read<uint32_t>(), CaptureResource::UBO);
+         uint64_t offset = r.read<uint32_t>();
+         uint32_t size;
+         auto data = r.block(&size);
+         if (ubo && data && offset + size <= UBOManager::getSize(ubo)) {
+            rdr._setUBOData(ubo, (size_t)offset, size, (void*)data);
+         }
+         break; }
+      case CaptureOp::BindUBO: {
+         auto ubo = (UBO*)get(r.read<uint32_t>(), CaptureResource::UBO);
+         auto slot = r.read<uint32_t>();
+         if (ubo) {
+            rdr.bindUBO(ubo, slot);
+         }
+         break; }
+      case CaptureOp::BindCubeMap: {
+         auto cm = (CubeMap*)get(r.read<uint32_t>(), CaptureResource::CubeMap);
+         auto slot = r.read<uint32_t>();
+         if (cm) {
+            rdr.bindCubeMap(cm, slot);
+         }
+         break; }
+      case CaptureOp::UpdateModelData: {
+         auto m = (Model*)get(r.read<uint32_t>(), CaptureResource::Model);
+         auto size = r.read<uint32_t>();
+         auto vCount = r.read<uint32_t>();
+         uint32_t dataSize;
+         auto data = r.block(&dataSize);
+         if (m && data && dataSize == (uint64_t)size * vCount) {
+            rdr._updateModelData(m, (void*)data, size, vCount);
+         }
+         break; }
+      case CaptureOp::RenderModel: {
+         auto m = (Model*)get(r.read<uint32_t>(), CaptureResource::Model);
+         auto type = r.read<byte>();
+         if (m && validRenderType(type)) {
+            rdr.renderModel(m, (ModelManager::RenderType)type);
+         }
+         break; }
+      case CaptureOp::RenderModelInstanced: {
+         auto m = (Model*)get(r.read<uint32_t>(), CaptureResource::Model);
+         auto type = r.read<byte>();
+         uint32_t dataSize;
+         auto data = r.block(&dataSize);
+         if (m && validRenderType(type) && data && dataSize % sizeof(ModelInstance) == 0) {
+            rdr._renderInstances(m, (ModelInstance const*)data, dataSize / sizeof(ModelInstance), (ModelManager::RenderType)type);
+         }
+         break; }
+      case CaptureOp::RenderModelBatch: {
+         auto type = r.read<byte>();
+         uint32_t idSize, instanceSize;
+         auto ids = (byte const*)r.block(&idSize);
+         auto instances = r.block(&instanceSize);
+
+         size_t batchCount = idSize / sizeof(uint32_t);
+         if (ids && instances && validRenderType(type) && instanceSize == batchCount * sizeof(ModelInstance)) {
+            std::vector<Model*> models(batchCount);
+            bool modelsValid = true;
+            for (size_t i = 0; i < batchCount; ++i) {
+               uint32_t id;
+               memcpy(&id, ids + i * sizeof(uint32_t), sizeof(id));
+               models[i] = (Model*)get(id, CaptureResource::Model);
+               modelsValid = modelsValid && models[i];
+            }
+            if (modelsValid) {
+               rdr.renderModelBatch(models.data(), (ModelInstance const*)instances, batchCount, (ModelManager::RenderType)type);
+            }
+         }
+         break; }
+      default:
+         //unknown op, nothing after it can be trusted
+         return count;
+      }
+
+      ++count;
+   }
+
+   return count;
+}
+
+#pragma endregion
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "Renderer.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary frame traces
+//
+// A trace is one finished frame worth of Renderer calls plus everything needed to recreate
+// the resources they reference. Layout:
+//    header   : magic, version, width, height
+//    resources: count, then (type, payload) per resource, ids are their index
+//    commands : byte count, then (op, args) records
+//
+// Everything is written in native byte order, traces aren't meant to move between architectures
+
+enum class CaptureOp : unsigned char {
+   Clear = 0,
+   Viewport,
+   EnableDepth,
+   EnableAlphaBlending,
+   EnableWireframe,
+   SetShader,
+   SetFloat2,
+   SetMatrix,
+   SetColor,
+   SetTextureSlot,
+   BindTexture,
+   SetUBOData,
+   BindUBO,
+   BindCubeMap,
+   UpdateModelData,
+   RenderModel,
+   RenderModelInstanced,
+   RenderModelBatch,
+   EnableColorWrite,
+   EnableDepthWrite,
+   SetRenderTarget,
+   BindRenderTarget,
+   BlitRenderTarget,
+   COUNT
+};
+
+enum class CaptureResource : unsigned char {
+   String = 0,
+   Shader,
+   Model,
+   Texture,
+   CubeMap,
+   UBO,
+   RenderTarget
+};
+
+// Records Renderer calls for a single frame, call from the recording side
+// Contexts get their own segment which is stitched in where the context was created
+class FrameCapture {
+public:
+   typedef std::vector<byte> Buffer;
+
+private:
+   std::string m_file;
+   size_t m_width, m_height;
+
+   //segments in replay order, the main thread always writes to the last main segment
+   std::vector<std::unique_ptr<Buffer>> m_segments;
+   Buffer *m_mainSegment;
+
+   std::mutex m_resourceMutex;
+   Buffer m_resources;
+   uint32_t m_resourceCount;
+   std::unordered_map<void const*, uint32_t> m_resourceIDs;
+
+   Buffer &segment();
+
+   //writePayload(Buffer&) only runs the first time key is seen
+   template<typename F>
+   uint32_t resource(void const *key, CaptureResource type, F const &writePayload);
+   uint32_t string(StringView str);
+   uint32_t shader(Shader *s);
+   uint32_t model(Model *m);
+   uint32_t texture(Texture *t);
+   uint32_t cubeMap(CubeMap *cm);
+   uint32_t ubo(UBO *ubo);
+   //nullptr, the window, gets NoResource
+   uint32_t renderTarget(RenderTarget *rt);
+
+   template<typename T>
+   static void write(Buffer &b, T const &value) {
+      auto bytes = (byte const*)&value;
+      b.insert(b.end(), bytes, bytes + sizeof(T));
+   }
+   static void writeBytes(Buffer &b, void const *data, size_t size);
+   static void writeString(Buffer &b, const char *str);
+
+public:
+   FrameCapture(std::string const &file, size_t width, size_t height);
+
+   //returns the segment commands recorded inside the context go to
+   Buffer *createContext();
+   //commands recorded on this thread go into segment until endContext()
+   void beginContext(Buffer *segment);
+   void endContext();
+
+   bool save();
+
+   void clear(ColorRGBAf const &c);
+   void viewport(Recti const &r);
+
+   void setRenderTarget(RenderTarget *rt);
+   void bindRenderTarget(RenderTarget *rt, TextureSlot slot);
+   void blitRenderTarget(RenderTarget *rt, Recti const &source, Recti const &dest);
+
+   void enableDepth(bool enabled);
+   void enableAlphaBlending(bool enabled);
+   void enableWireframe(bool enabled);
+   void enableColorWrite(bool enabled);
+   void enableDepthWrite(bool enabled);
+
+   void setShader(Shader *s);
+   void setFloat2(StringView u, Float2 const &value);
+   void setMatrix(StringView u, Matrix const &value);
+   void setColor(StringView u, ColorRGBAf const &value);
+
+   void setTextureSlot(StringView u, TextureSlot const &value);
+   void bindTexture(Texture *t, TextureSlot slot);
+
+   void setUBOData(UBO *ubo, size_t offset, size_t size, void *data);
+   void bindUBO(UBO *ubo, UBOSlot slot);
+   void bindCubeMap(CubeMap *cm, TextureSlot slot);
+
+   void updateModelData(Model *m, void *data, size_t size, size_t vCount);
+   void renderModel(Model *m, ModelManager::RenderType type);
+   void renderModelInstanced(Model *m, ModelInstance const *instances, size_t count, ModelManager::RenderType type);
+   void renderModelBatch(Model *const *models, ModelInstance const *instances, size_t count, ModelManager::RenderType type);
+};
+
+// Loads a trace, recreates its resources and re-records its commands into a Renderer
+class FrameReplay {
+   struct Resource {
+      CaptureResource type;
+      void *object;
+   };
+
+   std::vector<byte> m_file;
+   std::vector<Resource> m_resources;
+   size_t m_commandsBegin, m_commandsEnd;
+   size_t m_width, m_height;
+
+   void *get(uint32_t id, CaptureResource type) const;
+
+public:
+   FrameReplay();
+   ~FrameReplay();
+
+   bool load(const char *file);
+
+   size_t getWidth() const { return m_width; }
+   size_t getHeight() const { return m_height; }
+
+   //records the whole frame into r, call finish() and flush() as usual afterwards
+   //returns the number of commands recorded
+   size_t replay(Renderer &r) const;
+};
@@ -1,9 +1,12 @@
 #include "CubeMap.hpp"
 #include "Texture.hpp"
 
-#include "GL/glew.h"
+#include "GLDispatch.hpp"
+
+#include <atomic>
 
 class CubeMap {
+   int m_id;
    bool m_built = false;
    size_t m_size = 0;
    uintptr_t m_handle;
@@ -11,48 +14,55 @@ class CubeMap {
    std::vector<std::string> m_faceFiles;
 
    void build() {
-      glGenTextures(1, (GLuint*)&m_handle);
-      glActiveTexture(GL_TEXTURE0);
+      gl::GenTextures(1, (GLuint*)&m_handle);
 
-      glBindTexture(GL_TEXTURE_CUBE_MAP, m_handle);
-      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      gl::BindTexture(GL_TEXTURE_CUBE_MAP, m_handle);
+      gl::PixelStorei(GL_UNPACK_ALIGNMENT, 1);
       
 
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+      gl::TexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      gl::TexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      gl::TexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      gl::TexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      gl::TexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-      glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+      gl::TexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
       
       for (GLuint i = 0; i < m_faceFiles.size(); i++)
       {
          TextureBuffer buff = loadPng(m_faceFiles[i]);
 
-         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 
+         gl::TexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 
             GL_RGBA, buff.size.x, buff.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, buff.bits.get());
       }
       
-      glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+      gl::BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
       m_built = true;
    }
 
 public:
-   CubeMap(std::vector<std::string> const &faceFiles) :m_faceFiles(faceFiles) { }
+   CubeMap(std::vector<std::string> const &faceFiles) :m_faceFiles(faceFiles) {
+      static std::atomic<int> nextID(0);
+      m_id = nextID++;
+   }
    ~CubeMap() {
       if (m_built) {
       }
    }
 
+   int getID() { return m_id; }
+   std::vector<std::string> const &getFaceFiles() { return m_faceFiles; }
+
    void bind(TextureSlot slot) {
+      //activate first so the build binds land on the slot we're about to overwrite
+      gl::ActiveTexture(GL_TEXTURE0 + slot);
+
       if (!m_built) {
          build();
       }
 
-      glActiveTexture(GL_TEXTURE0 + slot);
-      glBindTexture(GL_TEXTURE_CUBE_MAP, m_handle);
+      gl::BindTexture(GL_TEXTURE_CUBE_MAP, m_handle);
 
    }
 
@@ -60,6 +70,8 @@ public:
 
 CubeMap *CubeMapManager::create(std::vector<std::string> const &faceFiles) { return new CubeMap(faceFiles); }
 void CubeMapManager::destroy(CubeMap *self) { delete self; }
+int CubeMapManager::getID(CubeMap *self) { return self->getID(); }
+std::vector<std::string> const &CubeMapManager::getFaceFiles(CubeMap *self) { return self->getFaceFiles(); }
 void CubeMapManager::bind(CubeMap *self, TextureSlot slot) { self->bind(slot); }
 
 
@@ -14,6 +14,9 @@ class CubeMapManager {
 public:
    static CubeMap *create(std::vector<std::string> const &faceFiles);
    static void destroy(CubeMap *self);
+   //small sequential id, stable for the life of the cubemap
+   static int getID(CubeMap *self);
+   static std::vector<std::string> const &getFaceFiles(CubeMap *self);
 
    static void bind(CubeMap *self, TextureSlot slot);
 };
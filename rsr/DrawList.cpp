@@ -0,0 +1,409 @@
+#include "DrawList.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <string.h>
+
+static const int LayerBits = 4;
+static const int BlendedBits = 1;
+static const int ShaderBits = 12;
+static const int TextureBits = 12;
+static const int ModelBits = 15;
+static const int DepthBits = 20;
+
+//cubemaps count their ids from 1 as well, the top texture bit keeps them apart from textures
+static const uint64_t CubeMapTextureBit = 1ull << (TextureBits - 1);
+
+//runs shorter than this are drawn one by one
+static const size_t MinBatchSize = 2;
+
+static const int DepthShift = 0;
+static const int ModelShift = DepthShift + DepthBits;
+static const int TextureShift = ModelShift + ModelBits;
+static const int ShaderShift = TextureShift + TextureBits;
+static const int BlendedShift = ShaderShift + ShaderBits;
+static const int LayerShift = BlendedShift + BlendedBits;
+
+//blended items order by depth before state
+static const int BlendedModelShift = 0;
+static const int BlendedTextureShift = BlendedModelShift + ModelBits;
+static const int BlendedShaderShift = BlendedTextureShift + TextureBits;
+static const int BlendedDepthShift = BlendedShaderShift + ShaderBits;
+
+static uint64_t keyField(uint64_t value, int bits, int shift) {
+   return (value & ((1ull << bits) - 1)) << shift;
+}
+
+//positive floats sort the same as their bit patterns, keep the top bits under the sign
+static uint64_t depthField(float depth) {
+   if (!(depth > 0.0f)) {
+      return 0;
+   }
+
+   uint32_t bits;
+   memcpy(&bits, &depth, sizeof(bits));
+   return bits >> (31 - DepthBits);
+}
+
+//clip w, the distance along the view direction
+static float viewDepth(Matrix const &viewProj, float x, float y, float z) {
+   return viewProj[3] * x + viewProj[7] * y + viewProj[11] * z + viewProj[15];
+}
+
+//lsd radix sort on 8 bit digits, passes where every key shares the same digit are skipped
+void DrawList::radixSort(std::vector<SortEntry> &entries, std::vector<SortEntry> &scratch) {
+   size_t count = entries.size();
+   if (count < 2) {
+      return;
+   }
+
+   scratch.resize(count);
+
+   size_t histogram[8][256] = { 0 };
+   for (auto && e : entries) {
+      for (int pass = 0; pass < 8; ++pass) {
+         ++histogram[pass][(e.key >> (pass * 8)) & 0xFF];
+      }
+   }
+
+   auto *src = &entries;
+   auto *dst = &scratch;
+
+   for (int pass = 0; pass < 8; ++pass) {
+      auto &h = histogram[pass];
+      int shift = pass * 8;
+
+      if (h[((*src)[0].key >> shift) & 0xFF] == count) {
+         continue;
+      }
+
+      size_t offsets[256];
+      size_t total = 0;
+      for (int i = 0; i < 256; ++i) {
+         offsets[i] = total;
+         total += h[i];
+      }
+
+      for (auto && e : *src) {
+         (*dst)[offsets[(e.key >> shift) & 0xFF]++] = e;
+      }
+
+      std::swap(src, dst);
+   }
+
+   if (src != &entries) {
+      entries.swap(scratch);
+   }
+}
+
+//about a pixel at 800 pixels tall
+static const float DefaultLODTolerance = 0.0025f;
+
+DrawList::DrawList() :m_lodTolerance(DefaultLODTolerance) {
+   m_uModel = ShaderManager::getUniformHandle(internString("uModelMatrix"));
+   m_uRotation = ShaderManager::getUniformHandle(internString("uModelRotation"));
+   m_uColor = ShaderManager::getUniformHandle(internString("uColorTransform"));
+   m_uTexture = ShaderManager::getUniformHandle(internString("uTexture"));
+   m_uSkybox = ShaderManager::getUniformHandle(internString("uSkybox"));
+}
+
+void DrawList::clear() {
+   m_items.clear();
+}
+
+void DrawList::push(DrawItem const &item) {
+   m_items.push_back(item);
+}
+
+bool DrawList::isBlended(DrawItem const &item) {
+   return item.blended || item.color.a < 1.0f;
+}
+
+uint64_t DrawList::makeKey(DrawItem const &item, float depth) const {
+   uint64_t textureID = 0;
+   if (item.texture) {
+      textureID = (TextureManager::getID(item.texture) + 1) & (CubeMapTextureBit - 1);
+   }
+   else if (item.cubeMap) {
+      textureID = ((CubeMapManager::getID(item.cubeMap) + 1) & (CubeMapTextureBit - 1)) | CubeMapTextureBit;
+   }
+
+   //batching items sort by the shader they'll actually be drawn with so their runs stay together
+   int shaderID = ShaderManager::getID(batches(item) ? item.batchShader : item.shader);
+   int modelID = ModelManager::getID(item.model);
+
+   if (isBlended(item)) {
+      uint64_t farFirst = ((1ull << DepthBits) - 1) - depthField(depth);
+
+      return
+         keyField(item.layer, LayerBits, LayerShift) |
+         keyField(1, BlendedBits, BlendedShift) |
+         keyField(farFirst, DepthBits, BlendedDepthShift) |
+         keyField(shaderID, ShaderBits, BlendedShaderShift) |
+         keyField(textureID, TextureBits, BlendedTextureShift) |
+         keyField(modelID, ModelBits, BlendedModelShift);
+   }
+
+   return
+      keyField(item.layer, LayerBits, LayerShift) |
+      keyField(shaderID, ShaderBits, ShaderShift) |
+      keyField(textureID, TextureBits, TextureShift) |
+      keyField(modelID, ModelBits, ModelShift) |
+      keyField(depthField(depth), DepthBits, DepthShift);
+}
+
+void DrawList::cull(Matrix const &viewProj) {
+   auto frustum = Frustum::fromMatrix(viewProj);
+
+   //length of the y row is the projection's y scale as long as the view has no scale of its own
+   float projScale = sqrtf(viewProj[1] * viewProj[1] + viewProj[5] * viewProj[5] + viewProj[9] * viewProj[9]);
+
+   size_t count = m_items.size();
+   m_boundsX.resize(count);
+   m_boundsY.resize(count);
+   m_boundsZ.resize(count);
+   m_boundsRadius.resize(count);
+   m_visible.resize(count);
+   m_depths.resize(count);
+   m_boxes.resize(count);
+
+   for (size_t i = 0; i < count; ++i) {
+      auto &item = m_items[i];
+      if (item.lod) {
+         item.model = item.lod->models[0];
+      }
+      auto bounds = ModelManager::getBounds(item.model);
+
+      if (!bounds.valid) {
+         m_boundsX[i] = m_boundsY[i] = m_boundsZ[i] = 0.0f;
+         m_boundsRadius[i] = std::numeric_limits<float>::infinity();
+         m_depths[i] = viewDepth(viewProj, item.transform[12], item.transform[13], item.transform[14]);
+         continue;
+      }
+
+      m_boxes[i] = bounds.box;
+
+      auto &m = item.transform;
+      auto &c = bounds.sphere.center;
+      m_boundsX[i] = m[0] * c.x + m[4] * c.y + m[8] * c.z + m[12];
+      m_boundsY[i] = m[1] * c.x + m[5] * c.y + m[9] * c.z + m[13];
+      m_boundsZ[i] = m[2] * c.x + m[6] * c.y + m[10] * c.z + m[14];
+
+      //non-uniform scales grow the sphere by the largest axis
+      float scaleSq = 0.0f;
+      for (int axis = 0; axis < 3; ++axis) {
+         scaleSq = std::max(scaleSq, vec::lensq({ m[axis * 4], m[axis * 4 + 1], m[axis * 4 + 2] }));
+      }
+      m_boundsRadius[i] = bounds.sphere.radius * sqrtf(scaleSq);
+      m_depths[i] = viewDepth(viewProj, m_boundsX[i], m_boundsY[i], m_boundsZ[i]);
+
+      if (item.lod) {
+         //inside the sphere always gets full detail
+         float w = m_depths[i];
+         if (w > m_boundsRadius[i]) {
+            float screenSize = m_boundsRadius[i] * projScale / w;
+            item.model = item.lod->models[item.lod->select(screenSize, m_lodTolerance)];
+         }
+      }
+   }
+
+   frustum.testSpheres(m_boundsX.data(), m_boundsY.data(), m_boundsZ.data(), m_boundsRadius.data(), count, m_visible.data());
+
+   m_cullStats.occluded = 0;
+   if (m_occlusion) {
+      cullOccluded(viewProj);
+   }
+}
+
+void DrawList::cullOccluded(Matrix const &viewProj) {
+   size_t count = m_items.size();
+
+   m_occlusion->begin(viewProj);
+   for (size_t i = 0; i < count; ++i) {
+      auto &item = m_items[i];
+      if (m_visible[i] && item.occluder) {
+         m_occlusion->addOccluder(*item.occluder, modelMatrix(item));
+      }
+   }
+   m_occlusion->end();
+
+   for (size_t i = 0; i < count; ++i) {
+      if (!m_visible[i] || isinf(m_boundsRadius[i])) {
+         continue;
+      }
+
+      if (!m_occlusion->isVisible(m_boxes[i], modelMatrix(m_items[i]))) {
+         m_visible[i] = 0;
+         ++m_cullStats.occluded;
+      }
+   }
+}
+
+Matrix DrawList::modelMatrix(DrawItem const &item) {
+   return item.hasRotation ? item.transform * item.rotation : item.transform;
+}
+
+void DrawList::submit(Renderer &r, Matrix const &viewProj) {
+   cull(viewProj);
+
+   m_entries.clear();
+   for (size_t i = 0; i < m_items.size(); ++i) {
+      if (m_visible[i]) {
+         m_entries.push_back({ makeKey(m_items[i], m_depths[i]), (uint32_t)i });
+      }
+   }
+
+   m_cullStats.visible = m_entries.size();
+   m_cullStats.culled = m_items.size() - m_entries.size() - m_cullStats.occluded;
+
+   radixSort(m_entries, m_scratch);
+
+   BoundState bound;
+
+   //one pass per layer and blend mode, in key order
+   for (size_t begin = 0; begin < m_entries.size();) {
+      uint64_t group = m_entries[begin].key >> BlendedShift;
+      size_t end = begin + 1;
+      while (end < m_entries.size() && (m_entries[end].key >> BlendedShift) == group) {
+         ++end;
+      }
+
+      if (group & 1) {
+         r.enableAlphaBlending(true);
+         r.enableDepthWrite(false);
+         draw(r, begin, end, false, bound);
+      }
+      else {
+         r.enableAlphaBlending(false);
+
+         if (m_prepass.shader) {
+            r.enableColorWrite(false);
+            r.enableDepthWrite(true);
+            draw(r, begin, end, true, bound);
+
+            //every depth the color pass can pass with is already there
+            r.enableColorWrite(true);
+            r.enableDepthWrite(false);
+         }
+         else {
+            r.enableDepthWrite(true);
+         }
+
+         draw(r, begin, end, false, bound);
+      }
+
+      begin = end;
+   }
+
+   r.enableAlphaBlending(false);
+   r.enableDepthWrite(true);
+}
+
+void DrawList::draw(Renderer &r, size_t begin, size_t end, bool depthOnly, BoundState &bound) {
+   for (size_t i = begin; i < end;) {
+      auto &item = m_items[m_entries[i].index];
+
+      size_t runEnd = batchEnd(i, end);
+      if (runEnd - i >= MinBatchSize) {
+         if (depthOnly) {
+            bindShader(r, m_prepass.batchShader, bound);
+         }
+         else {
+            bind(r, item.batchShader, item, bound);
+            r.setColor(m_uColor, CommonColors::White);
+         }
+
+         m_batchModels.clear();
+         m_batchInstances.clear();
+         for (; i < runEnd; ++i) {
+            auto &batched = m_items[m_entries[i].index];
+
+            ModelInstance instance;
+            instance.transform = modelMatrix(batched);
+            instance.color = batched.color;
+
+            m_batchModels.push_back(batched.model);
+            m_batchInstances.push_back(instance);
+         }
+
+         r.renderModelBatch(m_batchModels.data(), m_batchInstances.data(), m_batchModels.size(), item.renderType);
+         continue;
+      }
+
+      if (depthOnly) {
+         bindShader(r, item.hasRotation ? m_prepass.rotationShader : m_prepass.shader, bound);
+      }
+      else {
+         bind(r, item.shader, item, bound);
+      }
+
+      r.setMatrix(m_uModel, item.transform);
+      if (item.hasRotation) {
+         r.setMatrix(m_uRotation, item.rotation);
+      }
+      if (!depthOnly) {
+         r.setColor(m_uColor, item.color);
+      }
+      r.renderModel(item.model, item.renderType);
+      ++i;
+   }
+}
+
+bool DrawList::batches(DrawItem const &item) {
+   return item.batchShader && ModelManager::getBatchKey(item.model);
+}
+
+size_t DrawList::batchEnd(size_t begin, size_t limit) const {
+   auto &first = m_items[m_entries[begin].index];
+   if (!batches(first)) {
+      return begin + 1;
+   }
+
+   int key = ModelManager::getBatchKey(first.model);
+
+   size_t end = begin + 1;
+   for (; end < limit; ++end) {
+      auto &item = m_items[m_entries[end].index];
+      if (item.batchShader != first.batchShader ||
+         item.texture != first.texture ||
+         item.cubeMap != first.cubeMap ||
+         item.renderType != first.renderType ||
+         ModelManager::getBatchKey(item.model) != key) {
+         break;
+      }
+   }
+
+   return end;
+}
+
+bool DrawList::bindShader(Renderer &r, Shader *shader, BoundState &bound) {
+   if (shader == bound.shader) {
+      return false;
+   }
+
+   r.setShader(shader);
+   bound.shader = shader;
+   return true;
+}
+
+void DrawList::bind(Renderer &r, Shader *shader, DrawItem const &item, BoundState &bound) {
+   bool newShader = bindShader(r, shader, bound);
+
+   if (item.texture && (newShader || item.texture != bound.texture)) {
+      if (item.texture != bound.texture) {
+         r.bindTexture(item.texture, 0);
+         bound.texture = item.texture;
+         bound.cubeMap = nullptr;
+      }
+      r.setTextureSlot(m_uTexture, 0);
+   }
+   else if (item.cubeMap && (newShader || item.cubeMap != bound.cubeMap)) {
+      if (item.cubeMap != bound.cubeMap) {
+         r.bindCubeMap(item.cubeMap, 0);
+         bound.cubeMap = item.cubeMap;
+         bound.texture = nullptr;
+      }
+      r.setTextureSlot(m_uSkybox, 0);
+   }
+}
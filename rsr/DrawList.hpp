@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Occlusion.hpp"
+#include "Renderer.hpp"
+#include "Simplify.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+struct DrawItem {
+   Shader *shader = nullptr;
+   Model *model = nullptr;
+   //optional, replaces model with the level picked for the item's size on screen
+   ModelLOD const *lod = nullptr;
+   ModelManager::RenderType renderType = ModelManager::Triangles;
+
+   //optional, bound to slot 0
+   Texture *texture = nullptr;
+   CubeMap *cubeMap = nullptr;
+
+   Matrix transform = Matrix::identity();
+   Matrix rotation = Matrix::identity();
+   bool hasRotation = false; //only for shaders built with Rotation
+   ColorRGBAf color = CommonColors::White;
+
+   //optional, an Instanced build of shader without Rotation
+   //runs of items with the same batch shader, texture, render type and model batch key are drawn
+   //with one renderModelBatch, transform * rotation and color become the instance data
+   Shader *batchShader = nullptr;
+
+   //items in a lower layer always draw first, 0-15
+   unsigned int layer = 0;
+
+   //drawn after the layer's opaque items, back to front and without depth writes
+   //items whose color has alpha below 1 are blended either way
+   bool blended = false;
+
+   //optional, drawn into the occlusion culler whenever the item is in view, under transform * rotation
+   OccluderMesh const *occluder = nullptr;
+};
+
+//position only builds of depth.glsl for the pre-pass, each matching the variant an item is drawn with
+//all three are needed once shader is set
+struct DepthPrepassShaders {
+   Shader *shader = nullptr;
+   //for items with hasRotation
+   Shader *rotationShader = nullptr;
+   //Instanced, for batches
+   Shader *batchShader = nullptr;
+};
+
+struct CullStats {
+   //items without valid model bounds are never culled and count as visible
+   size_t visible = 0;
+   size_t culled = 0;
+   //in view but hidden behind occluders, not part of culled
+   size_t occluded = 0;
+};
+
+// Collects draw items for a frame and records them into the Renderer
+// items outside the view frustum or behind occluders are dropped, the rest are sorted by a 64-bit key. Within a layer
+// opaque items draw first, grouped so shader, texture and model switches only happen at boundaries
+// and front to back inside each group, then blended items draw back to front.
+//
+// key layout, msb first:
+//    layer   4           layer   4
+//    blended 1 (0)       blended 1 (1)
+//    shader  12          depth   20, inverted
+//    texture 12          shader  12
+//    model   15          texture 12
+//    depth   20          model   15
+class DrawList {
+   struct SortEntry {
+      uint64_t key;
+      uint32_t index;
+   };
+
+   std::vector<DrawItem> m_items;
+   std::vector<SortEntry> m_entries, m_scratch;
+
+   //world space bounding spheres of every item, one array per component so they test four at a time
+   std::vector<float> m_boundsX, m_boundsY, m_boundsZ, m_boundsRadius;
+   std::vector<uint8_t> m_visible;
+   //distance along the view direction
+   std::vector<float> m_depths;
+   //model space bounds for the occlusion test, only meaningful for items with a finite radius
+   std::vector<AABB> m_boxes;
+   OcclusionCuller *m_occlusion = nullptr;
+   CullStats m_cullStats;
+   float m_lodTolerance;
+   DepthPrepassShaders m_prepass;
+
+   std::vector<Model*> m_batchModels;
+   std::vector<ModelInstance> m_batchInstances;
+
+   //what the items recorded so far left bound
+   struct BoundState {
+      Shader *shader = nullptr;
+      Texture *texture = nullptr;
+      CubeMap *cubeMap = nullptr;
+   };
+
+   UniformHandle m_uModel, m_uRotation, m_uColor, m_uTexture, m_uSkybox;
+
+   static bool isBlended(DrawItem const &item);
+   uint64_t makeKey(DrawItem const &item, float depth) const;
+   static void radixSort(std::vector<SortEntry> &entries, std::vector<SortEntry> &scratch);
+   //also picks the lod level of items that have one
+   void cull(Matrix const &viewProj);
+   //clears m_visible for items the occluders hide
+   void cullOccluded(Matrix const &viewProj);
+   static Matrix modelMatrix(DrawItem const &item);
+   static bool batches(DrawItem const &item);
+   //end of the run of sorted entries starting at begin that can go into one batch, at most limit
+   size_t batchEnd(size_t begin, size_t limit) const;
+   //true when shader wasn't bound already
+   bool bindShader(Renderer &r, Shader *shader, BoundState &bound);
+   void bind(Renderer &r, Shader *shader, DrawItem const &item, BoundState &bound);
+   //records the sorted entries in [begin, end), with the pre-pass shaders when depthOnly
+   void draw(Renderer &r, size_t begin, size_t end, bool depthOnly, BoundState &bound);
+
+public:
+   DrawList();
+
+   void clear();
+   void push(DrawItem const &item);
+
+   //culls everything pushed since the last clear against viewProj, sorts what's left and records it into r
+   //expects depth testing on, leaves blending off and color and depth writes on
+   void submit(Renderer &r, Matrix const &viewProj);
+
+   //counts from the last submit
+   CullStats getCullStats() const { return m_cullStats; }
+
+   //largest error a lod level may show, as a fraction of half the viewport height
+   void setLODTolerance(float tolerance) { m_lodTolerance = tolerance; }
+
+   //when set, opaque items first write only depth so their color pass shades each pixel once
+   //pays off where opaque items cover each other a lot, default is off
+   void setDepthPrepass(DepthPrepassShaders const &shaders) { m_prepass = shaders; }
+
+   //when set, items that survive the frustum are also tested against the occluders of the ones in view
+   //the culler has to outlive the list, nullptr turns occlusion culling off again
+   void setOcclusionCuller(OcclusionCuller *culler) { m_occlusion = culler; }
+};
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <memory>
+#include <string.h>
+#include <type_traits>
 #include <vector>
 
 #include "Defs.hpp"
-#include "Singleton.hpp"
+#include "Profiler.hpp"
 
 
 class DrawQueue {
@@ -14,82 +16,227 @@ class DrawQueue {
       size_t size;
    };
 
-   class ICall {
-   public:
-      virtual size_t size() = 0;
-      virtual void destroy(void *buffer) = 0;
-      virtual void execute(void *buffer) = 0;
+   //bulk data (ubo contents, vertex data) lives next to the commands in its own arena
+   //so records stay small and the data outlives whatever the caller recorded it from
+   const static size_t PayloadBlockSize = 64 * 1024;
+   const static size_t PayloadAlignment = 16;
+   struct PayloadBlock {
+      std::unique_ptr<byte[]> data;
+      size_t capacity, size;
+   };
+
+   typedef void(*CallFunc)(void *buffer);
+
+   //every record in a page is a header followed by the lambda itself
+   //the header is written inline so replay never leaves the page to find out what to do
+   struct Header {
+      CallFunc execute;
+      CallFunc destroy; //null when the lambda is trivially destructible
+      size_t size;
+#ifdef RSR_PROFILE
+      const char *name; //consecutive commands with the same name replay inside one zone
+#endif
    };
 
    template<typename T>
-   class Call : public ICall {
+   class Call {
    public:
-      static const size_t m_size = sizeof(Call*) + sizeof(T);
+      static const size_t m_size = sizeof(Header) + sizeof(T);
       static const size_t m_padding = m_size % sizeof(void*);
       static const size_t m_paddedSize = m_size + (m_padding ? sizeof(void*) - m_padding : 0);
 
-      size_t size() {
-         return m_paddedSize;
-      }
-
-      void destroy(void *buffer) {
+      static void destroy(void *buffer) {
          ((T*)buffer)->~T();
       }
-      void execute(void *buffer) {
+      static void execute(void *buffer) {
          ((T*)buffer)->operator()();
       }
+
+      //resolved at compile time, trivially destructible lambdas never get a destroy entry
+      static CallFunc destroyFunc(std::true_type) { return nullptr; }
+      static CallFunc destroyFunc(std::false_type) { return &destroy; }
+      static CallFunc destroyFunc() { return destroyFunc(std::is_trivially_destructible<T>()); }
    };
 
-   std::vector<Page> m_pages;
+   //pages are individually allocated so growing the list only moves pointers
+   //pages past m_pageCount are kept around from previous frames for reuse
+   std::vector<std::unique_ptr<Page>> m_pages;
+   size_t m_pageCount;
 
-public:
-   DrawQueue() {
-   }
-   ~DrawQueue() {
-      for (auto && p : m_pages) {
+   std::vector<PayloadBlock> m_payload;
+   size_t m_payloadBlock;
+
+   //set once anything with a real destructor gets pushed, lets us skip the destroy pass entirely
+   bool m_needsDestroy;
+
+   void destroyCalls() {
+      if (!m_needsDestroy) {
+         return;
+      }
+
+      for (size_t pi = 0; pi < m_pageCount; ++pi) {
+         auto &p = *m_pages[pi];
          size_t i = 0;
          while (i < p.size) {
-            ICall *c = *(ICall**)(p.data + i);
+            Header *h = (Header*)(p.data + i);
 
-            c->destroy((void*)(p.data + i + sizeof(ICall*)));
-            i += c->size();
+            if (h->destroy) {
+               h->destroy((void*)(h + 1));
+            }
+            i += h->size;
          }
       }
+
+      m_needsDestroy = false;
    }
 
-   template<typename L>
-   void push(L && lambda) {
+   Page &nextPage() {
+      if (m_pageCount == m_pages.size()) {
+         m_pages.push_back(std::unique_ptr<Page>(new Page));
+      }
 
-      ICall *call = &Singleton<Call<typename std::decay<L>::type>>::Instance();
+      auto &p = *m_pages[m_pageCount++];
+      p.size = 0;
+      return p;
+   }
 
-      size_t callSize = call->size();
+   byte *allocPayload(size_t size) {
+      size = (size + PayloadAlignment - 1) & ~(PayloadAlignment - 1);
 
-      if (callSize > PageSize) {
-         return;
+      while (m_payloadBlock < m_payload.size()) {
+         auto &b = m_payload[m_payloadBlock];
+         if (b.size + size <= b.capacity) {
+            byte *out = b.data.get() + b.size;
+            b.size += size;
+            return out;
+         }
+
+         //only move on, the next block gets rewound when we land in it
+         if (++m_payloadBlock < m_payload.size()) {
+            m_payload[m_payloadBlock].size = 0;
+         }
+      }
+
+      //oversized uploads get a block all to themselves, it stays in the rotation after that
+      size_t capacity = PayloadBlockSize;
+      if (size > capacity) {
+         capacity = size;
+      }
+      m_payload.push_back({ std::unique_ptr<byte[]>(new byte[capacity]), capacity, size });
+      return m_payload.back().data.get();
+   }
+
+public:
+   DrawQueue():m_pageCount(0), m_payloadBlock(0), m_needsDestroy(false) {
+   }
+   ~DrawQueue() {
+      destroyCalls();
+   }
+
+   //runs the destructors of everything recorded but holds onto the pages
+   void reset() {
+      destroyCalls();
+      m_pageCount = 0;
+
+      m_payloadBlock = 0;
+      if (!m_payload.empty()) {
+         m_payload[0].size = 0;
       }
+   }
+
+   //reserves size bytes for the caller to fill, the pointer stays valid until the queue is reset
+   void *allocData(size_t size) {
+      return allocPayload(size);
+   }
 
-      if (m_pages.empty() || m_pages.back().size + callSize > PageSize) {
-         m_pages.push_back({ 0 });
+   //copies data into the queue, the pointer stays valid until the queue is reset
+   void *pushData(void const *data, size_t size) {
+      void *out = allocData(size);
+      memcpy(out, data, size);
+      return out;
+   }
+
+   //name is only kept when profiling
+   template<typename L>
+   void push(L && lambda, const char *name = nullptr) {
+      typedef typename std::decay<L>::type T;
+      typedef Call<T> C;
+
+      const size_t callSize = C::m_paddedSize;
+      static_assert(callSize <= PageSize, "DrawQueue command too large, move bulk data into pushData()");
+
+      Page *p = m_pageCount ? m_pages[m_pageCount - 1].get() : nullptr;
+      if (!p || p->size + callSize > PageSize) {
+         p = &nextPage();
       }
 
-      auto &p = m_pages.back();
+      Header *h = (Header*)(p->data + p->size);
+      h->execute = &C::execute;
+      h->destroy = C::destroyFunc();
+      h->size = callSize;
+#ifdef RSR_PROFILE
+      h->name = name;
+#else
+      (void)name;
+#endif
+      new(h + 1) T(std::forward<L>(lambda));
 
-      *(ICall**)(p.data + p.size) = call;
-      new(p.data + p.size + sizeof(ICall*)) L(std::forward<L>(lambda));
+      m_needsDestroy = m_needsDestroy || h->destroy != nullptr;
 
-      p.size += callSize;
+      p->size += callSize;
    }
 
    void draw() {
-      for (auto && p : m_pages) {
+#ifdef RSR_PROFILE
+      const char *zone = nullptr;
+#endif
+
+      for (size_t pi = 0; pi < m_pageCount; ++pi) {
+         auto &p = *m_pages[pi];
          size_t i = 0;
          while (i < p.size) {
-            ICall *c = *(ICall**)(p.data + i);
-
-            c->execute((void*)(p.data + i + sizeof(ICall*)));
-            i += c->size();
+            Header *h = (Header*)(p.data + i);
+
+#ifdef RSR_PROFILE
+            if (h->name != zone) {
+               if (zone) {
+                  Profiler::endZone();
+               }
+               zone = h->name;
+               if (zone) {
+                  Profiler::beginZone(zone);
+               }
+            }
+#endif
+
+            h->execute((void*)(h + 1));
+            i += h->size;
          }
       }
+
+#ifdef RSR_PROFILE
+      if (zone) {
+         Profiler::endZone();
+      }
+#endif
    }
 };
 
+//hands out queues for recording, a queue is free again once nobody else holds a reference to it
+//only touch from the recording thread
+class DrawQueuePool {
+   std::vector<std::shared_ptr<DrawQueue>> m_queues;
+
+public:
+   std::shared_ptr<DrawQueue> acquire() {
+      for (auto && q : m_queues) {
+         if (q.use_count() == 1) {
+            q->reset();
+            return q;
+         }
+      }
+
+      m_queues.push_back(std::make_shared<DrawQueue>());
+      return m_queues.back();
+   }
+};
@@ -0,0 +1,126 @@
+#include "DynamicResolution.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+//frame times inside [LowWater, HighWater] * budget leave the scale alone
+static const double HighWater = 0.95;
+static const double LowWater = 0.75;
+//what a change aims for, in the middle of the band
+static const double Target = 0.85;
+//fraction of the way to the new scale taken per frame
+static const float Easing = 0.1f;
+//begin calls before an outgrown target goes, the frame that last used it plus the two a render thread can have waiting
+static const int RetireFrames = 3;
+
+DynamicResolution::DynamicResolution(double budget, float minScale, float maxScale)
+   :m_budget(budget), m_minScale(minScale), m_maxScale(maxScale), m_scale(maxScale) {
+   m_uTexture = ShaderManager::getUniformHandle(internString("uTexture"));
+   m_uSourceScale = ShaderManager::getUniformHandle(internString("uSourceScale"));
+   m_uSourceOffset = ShaderManager::getUniformHandle(internString("uSourceOffset"));
+   m_uTexelSize = ShaderManager::getUniformHandle(internString("uTexelSize"));
+   m_uSharpness = ShaderManager::getUniformHandle(internString("uSharpness"));
+}
+
+DynamicResolution::~DynamicResolution() {
+   for (auto && r : m_retired) {
+      RenderTargetManager::destroy(r.target);
+   }
+   if (m_target) {
+      RenderTargetManager::destroy(m_target);
+   }
+   if (m_quad) {
+      ModelManager::destroy(m_quad);
+   }
+}
+
+void DynamicResolution::setUpscaleShader(Shader *shader, float sharpness) {
+   m_upscaleShader = shader;
+   m_sharpness = sharpness;
+
+   if (shader && !m_quad) {
+      std::vector<FVF_Pos2_Tex2_Col4> vertices = {
+         { { -1.0f, -1.0f }, { 0.0f, 0.0f }, CommonColors::White },
+         { {  1.0f, -1.0f }, { 1.0f, 0.0f }, CommonColors::White },
+         { {  1.0f,  1.0f }, { 1.0f, 1.0f }, CommonColors::White },
+         { { -1.0f, -1.0f }, { 0.0f, 0.0f }, CommonColors::White },
+         { {  1.0f,  1.0f }, { 1.0f, 1.0f }, CommonColors::White },
+         { { -1.0f,  1.0f }, { 0.0f, 1.0f }, CommonColors::White }
+      };
+      m_quad = ModelManager::create(vertices);
+   }
+}
+
+void DynamicResolution::updateScale(double gpuFrameTime) {
+   if (gpuFrameTime <= 0.0) {
+      return;
+   }
+
+   double load = gpuFrameTime / m_budget;
+   if (load >= LowWater && load <= HighWater) {
+      return;
+   }
+
+   //fill cost goes with the pixel count, so each axis with its square root
+   float wanted = m_scale * (float)sqrt(Target / load);
+   wanted = std::min(m_maxScale, std::max(m_minScale, wanted));
+   m_scale += (wanted - m_scale) * Easing;
+}
+
+void DynamicResolution::begin(Renderer &r) {
+   Int2 size = { (int)r.getWidth(), (int)r.getHeight() };
+
+   for (size_t i = 0; i < m_retired.size();) {
+      if (--m_retired[i].framesLeft > 0) {
+         ++i;
+         continue;
+      }
+
+      RenderTargetManager::destroy(m_retired[i].target);
+      m_retired.erase(m_retired.begin() + i);
+   }
+
+   //only ever grows, a smaller window keeps drawing into the corner of the old one
+   if (!m_target || size.x > m_size.x || size.y > m_size.y) {
+      if (m_target) {
+         m_retired.push_back({ m_target, RetireFrames });
+      }
+
+      m_size = { std::max(m_size.x, size.x), std::max(m_size.y, size.y) };
+      m_target = RenderTargetManager::create(m_size);
+   }
+
+   updateScale(r.getStats().gpuFrameTime);
+
+   m_renderSize = {
+      std::max(1, std::min(m_size.x, (int)(size.x * m_scale + 0.5f))),
+      std::max(1, std::min(m_size.y, (int)(size.y * m_scale + 0.5f))) };
+
+   r.setRenderTarget(m_target);
+   r.viewport({ 0, 0, m_renderSize.x, m_renderSize.y });
+}
+
+void DynamicResolution::end(Renderer &r) {
+   Int2 size = { (int)r.getWidth(), (int)r.getHeight() };
+
+   r.setRenderTarget(nullptr);
+   r.viewport({ 0, 0, size.x, size.y });
+
+   if (!m_upscaleShader) {
+      r.blitRenderTarget(m_target, { 0, 0, m_renderSize.x, m_renderSize.y }, { 0, 0, size.x, size.y });
+      return;
+   }
+
+   //the scene sits in the top left, which in uv is the top of the texture
+   Float2 sourceScale = { (float)m_renderSize.x / m_size.x, (float)m_renderSize.y / m_size.y };
+
+   r.enableDepth(false);
+   r.setShader(m_upscaleShader);
+   r.bindRenderTarget(m_target, 0);
+   r.setTextureSlot(m_uTexture, 0);
+   r.setFloat2(m_uSourceScale, sourceScale);
+   r.setFloat2(m_uSourceOffset, { 0.0f, 1.0f - sourceScale.y });
+   r.setFloat2(m_uTexelSize, { 1.0f / m_size.x, 1.0f / m_size.y });
+   r.setFloat2(m_uSharpness, { m_sharpness, 0.0f });
+   r.renderModel(m_quad);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Renderer.hpp"
+
+#include <vector>
+
+// Renders into an offscreen target at a scale picked from the measured gpu frame time and stretches
+// the result over the window, so heavy frames cost resolution instead of frame rate
+//
+// The target is allocated at full window size and a frame only draws into its top left corner, changing
+// the scale never reallocates anything, only a window growing past it does. Timings trail a frame or two behind, so the scale only moves
+// once the frame time leaves a band under the budget and then eases toward it.
+class DynamicResolution {
+   RenderTarget *m_target = nullptr;
+   Int2 m_size = { 0, 0 }, m_renderSize = { 0, 0 };
+
+   //targets the window outgrew, destroyed once no frame in flight can still draw into them
+   struct RetiredTarget {
+      RenderTarget *target;
+      int framesLeft;
+   };
+   std::vector<RetiredTarget> m_retired;
+
+   double m_budget;
+   float m_minScale, m_maxScale, m_scale;
+
+   Shader *m_upscaleShader = nullptr;
+   Model *m_quad = nullptr;
+   float m_sharpness = 0.0f;
+   UniformHandle m_uTexture, m_uSourceScale, m_uSourceOffset, m_uTexelSize, m_uSharpness;
+
+   void updateScale(double gpuFrameTime);
+
+public:
+   //budget is the gpu time in ms a frame should take, scales are per axis
+   DynamicResolution(double budget = 16.0, float minScale = 0.5f, float maxScale = 1.0f);
+   //destroys GL objects, call where the renderer's managers can
+   ~DynamicResolution();
+
+   //picks this frame's scale from the renderer's last gpuFrameTime, then sends drawing into the target
+   //with the viewport set to the scaled size
+   void begin(Renderer &r);
+   //stretches what was drawn since begin over the window and sets the viewport back to all of it
+   //leaves depth testing off
+   void end(Renderer &r);
+
+   //a filtered blit by default, with a shader built from assets/upscale.glsl the stretch also sharpens
+   //by sharpness, around 0.2 undoes most of the blur
+   void setUpscaleShader(Shader *shader, float sharpness);
+   void setBudget(double budget) { m_budget = budget; }
+
+   float getScale() const { return m_scale; }
+   //size the last begin rendered at
+   Int2 getRenderSize() const { return m_renderSize; }
+};
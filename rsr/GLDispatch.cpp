@@ -0,0 +1,521 @@
+#include "GLDispatch.hpp"
+#include "Defs.hpp"
+#include "Singleton.hpp"
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gl {
+   Dispatch table;
+}
+
+using namespace gl;
+
+static Backend g_backend = Backend::Driver;
+//same fields as Counters, bumped with relaxed adds since the render thread calls gl while the main thread reads them
+static struct {
+   std::atomic<size_t> calls[FunctionCount];
+   std::atomic<size_t> drawCalls;
+   std::atomic<size_t> stateChanges;
+   std::atomic<size_t> bytesUploaded;
+} g_counters;
+
+static void addCount(std::atomic<size_t> &counter, size_t amount = 1) {
+   counter.fetch_add(amount, std::memory_order_relaxed);
+}
+
+#define RSR_GL_NAME(ret, name, params, args, kind) "gl" #name,
+static const char *const g_names[FunctionCount] = {
+   RSR_GL_FUNCTIONS(RSR_GL_NAME)
+};
+#undef RSR_GL_NAME
+
+//just enough of the driver's bookkeeping for the engine to run against nothing, gl thread only
+class NullGL {
+   GLuint m_nextName = 1;
+   uintptr_t m_nextSync = 1;
+
+   std::unordered_map<GLenum, GLuint> m_bound;
+   std::unordered_map<GLuint, size_t> m_bufferSizes;
+   std::unordered_map<GLuint, std::vector<byte>> m_mapped;
+
+   std::unordered_map<GLuint, std::string> m_shaderSources;
+   std::unordered_map<GLuint, std::vector<GLuint>> m_programShaders;
+   std::unordered_map<GLuint, std::vector<std::string>> m_programUniforms;
+
+   static bool isIdentChar(char c) {
+      return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+   }
+
+   static std::string readIdent(const char *&c) {
+      while (*c == ' ' || *c == '\t') {
+         ++c;
+      }
+      auto start = c;
+      while (isIdentChar(*c)) {
+         ++c;
+      }
+      return std::string(start, c);
+   }
+
+   //the uniforms outside of blocks, going through #define/#ifdef/#else/#endif so that shader
+   //variants report what the real compiler would
+   static void scanUniforms(std::string const &source, std::vector<std::string> &out) {
+      struct Branch {
+         bool parentLive, taken;
+      };
+
+      std::vector<std::string> defines;
+      std::vector<Branch> branches;
+      auto isDefined = [&](std::string const &name) {
+         for (auto && d : defines) {
+            if (d == name) {
+               return true;
+            }
+         }
+         return false;
+      };
+      auto live = [&]() { return branches.empty() || (branches.back().parentLive && branches.back().taken); };
+
+      size_t lineStart = 0;
+      while (lineStart < source.size()) {
+         size_t lineEnd = source.find('\n', lineStart);
+         if (lineEnd == std::string::npos) {
+            lineEnd = source.size();
+         }
+         std::string line = source.substr(lineStart, lineEnd - lineStart);
+         lineStart = lineEnd + 1;
+
+         const char *c = line.c_str();
+         while (*c == ' ' || *c == '\t') {
+            ++c;
+         }
+
+         if (*c == '#') {
+            ++c;
+            auto directive = readIdent(c);
+
+            if (directive == "define") {
+               if (live()) {
+                  defines.push_back(readIdent(c));
+               }
+            }
+            else if (directive == "ifdef" || directive == "ifndef") {
+               bool defined = isDefined(readIdent(c));
+               branches.push_back({ live(), directive == "ifdef" ? defined : !defined });
+            }
+            else if (directive == "if") {
+               //only "#if defined(X)" comes up, anything else is assumed true
+               auto word = readIdent(c);
+               bool taken = true;
+               if (word == "defined") {
+                  while (*c == ' ' || *c == '(') {
+                     ++c;
+                  }
+                  taken = isDefined(readIdent(c));
+               }
+               branches.push_back({ live(), taken });
+            }
+            else if ((directive == "else" || directive == "elif") && !branches.empty()) {
+               branches.back().taken = !branches.back().taken;
+            }
+            else if (directive == "endif" && !branches.empty()) {
+               branches.pop_back();
+            }
+            continue;
+         }
+
+         if (!live()) {
+            continue;
+         }
+
+         auto found = strstr(c, "uniform");
+         if (!found || (found != c && isIdentChar(found[-1])) || isIdentChar(found[7])) {
+            continue;
+         }
+
+         c = found + 7;
+         readIdent(c);
+         auto name = readIdent(c);
+
+         //"uniform Block {" leaves no name behind the type
+         if (name.empty()) {
+            continue;
+         }
+
+         bool known = false;
+         for (auto && u : out) {
+            known |= u == name;
+         }
+         if (!known) {
+            out.push_back(name);
+         }
+      }
+   }
+
+public:
+   GLuint genName() { return m_nextName++; }
+   GLsync genSync() { return (GLsync)m_nextSync++; }
+
+   void bindBuffer(GLenum target, GLuint buffer) { m_bound[target] = buffer; }
+   void setBufferSize(GLenum target, size_t size) { m_bufferSizes[m_bound[target]] = size; }
+
+   //the whole buffer is backed on first map, so every later range of it stays valid
+   void *mapBuffer(GLenum target, size_t offset, size_t length) {
+      auto buffer = m_bound[target];
+      auto &memory = m_mapped[buffer];
+      if (memory.empty()) {
+         auto size = m_bufferSizes[buffer];
+         memory.resize(size > offset + length ? size : offset + length);
+      }
+      return memory.data() + offset;
+   }
+
+   void unmapBuffer(GLenum target) { m_mapped.erase(m_bound[target]); }
+
+   void deleteBuffer(GLuint buffer) {
+      m_mapped.erase(buffer);
+      m_bufferSizes.erase(buffer);
+   }
+
+   void setShaderSource(GLuint shader, GLsizei count, const GLchar *const *strings, const GLint *lengths) {
+      auto &source = m_shaderSources[shader];
+      source.clear();
+      for (GLsizei i = 0; i < count; ++i) {
+         if (lengths && lengths[i] >= 0) {
+            source.append(strings[i], lengths[i]);
+         }
+         else {
+            source.append(strings[i]);
+         }
+      }
+   }
+
+   void attachShader(GLuint program, GLuint shader) { m_programShaders[program].push_back(shader); }
+
+   void linkProgram(GLuint program) {
+      auto &uniforms = m_programUniforms[program];
+      uniforms.clear();
+      for (auto && shader : m_programShaders[program]) {
+         scanUniforms(m_shaderSources[shader], uniforms);
+      }
+   }
+
+   std::vector<std::string> const &getUniforms(GLuint program) { return m_programUniforms[program]; }
+};
+typedef Singleton<NullGL> nullGL;
+
+template<typename T>
+static T nullResult() { return T(); }
+
+#define RSR_NULL_Plain(name) addCount(g_counters.calls[Fn_##name]);
+#define RSR_NULL_State(name) addCount(g_counters.calls[Fn_##name]); addCount(g_counters.stateChanges);
+#define RSR_NULL_Draw(name) addCount(g_counters.calls[Fn_##name]); addCount(g_counters.drawCalls);
+
+#define RSR_NULL_FUNCTION_Plain(ret, name, params) \
+   static ret GLAPIENTRY null##name params { RSR_NULL_Plain(name) return nullResult<ret>(); }
+#define RSR_NULL_FUNCTION_State(ret, name, params) \
+   static ret GLAPIENTRY null##name params { RSR_NULL_State(name) return nullResult<ret>(); }
+#define RSR_NULL_FUNCTION_Draw(ret, name, params) \
+   static ret GLAPIENTRY null##name params { RSR_NULL_Draw(name) return nullResult<ret>(); }
+#define RSR_NULL_FUNCTION_Custom(ret, name, params)
+
+#define RSR_NULL_FUNCTION(ret, name, params, args, kind) RSR_NULL_FUNCTION_##kind(ret, name, params)
+RSR_GL_FUNCTIONS(RSR_NULL_FUNCTION)
+#undef RSR_NULL_FUNCTION
+
+static void GLAPIENTRY nullAttachShader(GLuint program, GLuint shader) {
+   RSR_NULL_Plain(AttachShader)
+   nullGL::Instance().attachShader(program, shader);
+}
+
+static void GLAPIENTRY nullBindBuffer(GLenum target, GLuint buffer) {
+   RSR_NULL_State(BindBuffer)
+   nullGL::Instance().bindBuffer(target, buffer);
+}
+
+static void GLAPIENTRY nullBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage) {
+   RSR_NULL_Plain(BufferData)
+   nullGL::Instance().setBufferSize(target, size);
+   addCount(g_counters.bytesUploaded, data ? size : 0);
+}
+
+static void GLAPIENTRY nullBufferStorage(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags) {
+   RSR_NULL_Plain(BufferStorage)
+   nullGL::Instance().setBufferSize(target, size);
+   addCount(g_counters.bytesUploaded, data ? size : 0);
+}
+
+static void GLAPIENTRY nullBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data) {
+   RSR_NULL_Plain(BufferSubData)
+   addCount(g_counters.bytesUploaded, size);
+}
+
+static GLenum GLAPIENTRY nullClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) {
+   RSR_NULL_Plain(ClientWaitSync)
+   return GL_ALREADY_SIGNALED;
+}
+
+static GLenum GLAPIENTRY nullCheckNamedFramebufferStatus(GLuint framebuffer, GLenum target) {
+   RSR_NULL_Plain(CheckNamedFramebufferStatus)
+   return GL_FRAMEBUFFER_COMPLETE;
+}
+
+static GLuint GLAPIENTRY nullCreateProgram() {
+   RSR_NULL_Plain(CreateProgram)
+   return nullGL::Instance().genName();
+}
+
+static GLuint GLAPIENTRY nullCreateShader(GLenum type) {
+   RSR_NULL_Plain(CreateShader)
+   return nullGL::Instance().genName();
+}
+
+static void GLAPIENTRY nullDeleteBuffers(GLsizei n, const GLuint *buffers) {
+   RSR_NULL_Plain(DeleteBuffers)
+   for (GLsizei i = 0; i < n; ++i) {
+      nullGL::Instance().deleteBuffer(buffers[i]);
+   }
+}
+
+static GLsync GLAPIENTRY nullFenceSync(GLenum condition, GLbitfield flags) {
+   RSR_NULL_Plain(FenceSync)
+   return nullGL::Instance().genSync();
+}
+
+static void genNames(GLsizei n, GLuint *names) {
+   for (GLsizei i = 0; i < n; ++i) {
+      names[i] = nullGL::Instance().genName();
+   }
+}
+
+static void GLAPIENTRY nullCreateFramebuffers(GLsizei n, GLuint *framebuffers) {
+   RSR_NULL_Plain(CreateFramebuffers)
+   genNames(n, framebuffers);
+}
+
+static void GLAPIENTRY nullCreateRenderbuffers(GLsizei n, GLuint *renderbuffers) {
+   RSR_NULL_Plain(CreateRenderbuffers)
+   genNames(n, renderbuffers);
+}
+
+static void GLAPIENTRY nullCreateTextures(GLenum target, GLsizei n, GLuint *textures) {
+   RSR_NULL_Plain(CreateTextures)
+   genNames(n, textures);
+}
+
+static void GLAPIENTRY nullGenBuffers(GLsizei n, GLuint *buffers) {
+   RSR_NULL_Plain(GenBuffers)
+   genNames(n, buffers);
+}
+
+static void GLAPIENTRY nullGenQueries(GLsizei n, GLuint *ids) {
+   RSR_NULL_Plain(GenQueries)
+   genNames(n, ids);
+}
+
+static void GLAPIENTRY nullGenTextures(GLsizei n, GLuint *textures) {
+   RSR_NULL_Plain(GenTextures)
+   genNames(n, textures);
+}
+
+static void GLAPIENTRY nullGenVertexArrays(GLsizei n, GLuint *arrays) {
+   RSR_NULL_Plain(GenVertexArrays)
+   genNames(n, arrays);
+}
+
+static void copyString(std::string const &source, GLsizei bufSize, GLsizei *length, GLchar *out) {
+   GLsizei copied = 0;
+   if (bufSize > 0) {
+      copied = (GLsizei)source.size() < bufSize - 1 ? (GLsizei)source.size() : bufSize - 1;
+      memcpy(out, source.data(), copied);
+      out[copied] = 0;
+   }
+   if (length) {
+      *length = copied;
+   }
+}
+
+static void GLAPIENTRY nullGetActiveUniform(GLuint program, GLuint index, GLsizei maxLength, GLsizei *length, GLint *size, GLenum *type, GLchar *name) {
+   RSR_NULL_Plain(GetActiveUniform)
+   auto &uniforms = nullGL::Instance().getUniforms(program);
+   copyString(index < uniforms.size() ? uniforms[index] : std::string(), maxLength, length, name);
+   *size = 1;
+   *type = 0;
+}
+
+static void GLAPIENTRY nullGetInteger64v(GLenum pname, GLint64 *params) {
+   RSR_NULL_Plain(GetInteger64v)
+   *params = 0;
+}
+
+static void GLAPIENTRY nullGetIntegerv(GLenum pname, GLint *params) {
+   RSR_NULL_Plain(GetIntegerv)
+   *params = pname == GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT ? 256 : 0;
+}
+
+static void GLAPIENTRY nullGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+   RSR_NULL_Plain(GetProgramInfoLog)
+   copyString(std::string(), bufSize, length, infoLog);
+}
+
+static void GLAPIENTRY nullGetProgramiv(GLuint program, GLenum pname, GLint *param) {
+   RSR_NULL_Plain(GetProgramiv)
+   auto &uniforms = nullGL::Instance().getUniforms(program);
+
+   switch (pname) {
+   case GL_LINK_STATUS:
+      *param = GL_TRUE;
+      break;
+   case GL_ACTIVE_UNIFORMS:
+      *param = (GLint)uniforms.size();
+      break;
+   case GL_ACTIVE_UNIFORM_MAX_LENGTH:
+      *param = 0;
+      for (auto && u : uniforms) {
+         *param = (GLint)u.size() + 1 > *param ? (GLint)u.size() + 1 : *param;
+      }
+      break;
+   default:
+      *param = 0;
+   }
+}
+
+static void GLAPIENTRY nullGetQueryObjectiv(GLuint id, GLenum pname, GLint *params) {
+   RSR_NULL_Plain(GetQueryObjectiv)
+   *params = pname == GL_QUERY_RESULT_AVAILABLE ? GL_TRUE : 0;
+}
+
+static void GLAPIENTRY nullGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params) {
+   RSR_NULL_Plain(GetQueryObjectui64v)
+   *params = 0;
+}
+
+static void GLAPIENTRY nullGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+   RSR_NULL_Plain(GetShaderInfoLog)
+   copyString(std::string(), bufSize, length, infoLog);
+}
+
+static void GLAPIENTRY nullGetShaderSource(GLuint shader, GLsizei maxLength, GLsizei *length, GLchar *source) {
+   RSR_NULL_Plain(GetShaderSource)
+   copyString(std::string(), maxLength, length, source);
+}
+
+static void GLAPIENTRY nullGetShaderiv(GLuint shader, GLenum pname, GLint *param) {
+   RSR_NULL_Plain(GetShaderiv)
+   *param = pname == GL_COMPILE_STATUS ? GL_TRUE : 0;
+}
+
+static GLint GLAPIENTRY nullGetUniformLocation(GLuint program, const GLchar *name) {
+   RSR_NULL_Plain(GetUniformLocation)
+   auto &uniforms = nullGL::Instance().getUniforms(program);
+   for (size_t i = 0; i < uniforms.size(); ++i) {
+      if (uniforms[i] == name) {
+         return (GLint)i;
+      }
+   }
+   return -1;
+}
+
+static void GLAPIENTRY nullLinkProgram(GLuint program) {
+   RSR_NULL_Plain(LinkProgram)
+   nullGL::Instance().linkProgram(program);
+}
+
+static void *GLAPIENTRY nullMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+   RSR_NULL_Plain(MapBufferRange)
+   return nullGL::Instance().mapBuffer(target, offset, length);
+}
+
+static void GLAPIENTRY nullShaderSource(GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length) {
+   RSR_NULL_Plain(ShaderSource)
+   nullGL::Instance().setShaderSource(shader, count, string, length);
+}
+
+static void GLAPIENTRY nullTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels) {
+   RSR_NULL_Plain(TexImage2D)
+   if (!pixels) {
+      return;
+   }
+
+   size_t channels = format == GL_RGB || format == GL_BGR ? 3 : format == GL_RED || format == GL_ALPHA ? 1 : 4;
+   size_t channelSize = type == GL_FLOAT ? 4 : 1;
+   addCount(g_counters.bytesUploaded, width * height * channels * channelSize);
+}
+
+static void GLAPIENTRY nullUniform1i(GLint location, GLint v0) {
+   RSR_NULL_Plain(Uniform1i)
+   addCount(g_counters.bytesUploaded, sizeof(GLint));
+}
+
+static void GLAPIENTRY nullUniform2fv(GLint location, GLsizei count, const GLfloat *value) {
+   RSR_NULL_Plain(Uniform2fv)
+   addCount(g_counters.bytesUploaded, count * 2 * sizeof(GLfloat));
+}
+
+static void GLAPIENTRY nullUniform4fv(GLint location, GLsizei count, const GLfloat *value) {
+   RSR_NULL_Plain(Uniform4fv)
+   addCount(g_counters.bytesUploaded, count * 4 * sizeof(GLfloat));
+}
+
+static void GLAPIENTRY nullUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+   RSR_NULL_Plain(UniformMatrix4fv)
+   addCount(g_counters.bytesUploaded, count * 16 * sizeof(GLfloat));
+}
+
+static GLboolean GLAPIENTRY nullUnmapBuffer(GLenum target) {
+   RSR_NULL_Plain(UnmapBuffer)
+   nullGL::Instance().unmapBuffer(target);
+   return GL_TRUE;
+}
+
+void gl::setBackend(Backend backend) { g_backend = backend; }
+Backend gl::getBackend() { return g_backend; }
+
+void gl::load() {
+   if (g_backend == Backend::Null) {
+#define RSR_GL_NULL(ret, name, params, args, kind) table.name = null##name;
+      RSR_GL_FUNCTIONS(RSR_GL_NULL)
+#undef RSR_GL_NULL
+      return;
+   }
+
+   //core 1.1 entry points come straight from the gl library, glew has pointers for the rest
+   glewInit();
+#define RSR_GL_DRIVER(ret, name, params, args, kind) table.name = gl##name;
+   RSR_GL_FUNCTIONS(RSR_GL_DRIVER)
+#undef RSR_GL_DRIVER
+}
+
+size_t Counters::totalCalls() const {
+   size_t total = 0;
+   for (auto && c : calls) {
+      total += c;
+   }
+   return total;
+}
+
+Counters gl::getCounters() {
+   Counters out;
+   for (int i = 0; i < FunctionCount; ++i) {
+      out.calls[i] = g_counters.calls[i].load(std::memory_order_relaxed);
+   }
+   out.drawCalls = g_counters.drawCalls.load(std::memory_order_relaxed);
+   out.stateChanges = g_counters.stateChanges.load(std::memory_order_relaxed);
+   out.bytesUploaded = g_counters.bytesUploaded.load(std::memory_order_relaxed);
+   return out;
+}
+
+void gl::resetCounters() {
+   for (auto &c : g_counters.calls) {
+      c.store(0, std::memory_order_relaxed);
+   }
+   g_counters.drawCalls.store(0, std::memory_order_relaxed);
+   g_counters.stateChanges.store(0, std::memory_order_relaxed);
+   g_counters.bytesUploaded.store(0, std::memory_order_relaxed);
+}
+const char *gl::getName(Function function) { return g_names[function]; }
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "GL/glew.h"
+
+#include <stddef.h>
+
+// Every GL entry point the engine calls goes through gl::, e.g. gl::BindBuffer(...)
+// The calls land in a table of function pointers that load() fills either from the driver or
+// from the null backend, which executes nothing and only counts. Switching needs no rebuild,
+// so the cpu side of submission can be measured on machines without a gpu or a display.
+// Anything new has to be added to RSR_GL_FUNCTIONS, the null backend needs an entry for Custom ones.
+
+//X(return type, name without the gl prefix, parameters, arguments, what the null backend counts it as)
+//Plain is only counted, State and Draw also bump their totals, Custom is written out by hand
+#define RSR_GL_FUNCTIONS(X) \
+   X(void, ActiveTexture, (GLenum texture), (texture), State) \
+   X(void, AlphaFunc, (GLenum func, GLclampf ref), (func, ref), State) \
+   X(void, AttachShader, (GLuint program, GLuint shader), (program, shader), Custom) \
+   X(void, BindAttribLocation, (GLuint program, GLuint index, const GLchar *name), (program, index, name), Plain) \
+   X(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer), Custom) \
+   X(void, BindBufferRange, (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size), (target, index, buffer, offset, size), State) \
+   X(void, BindFramebuffer, (GLenum target, GLuint framebuffer), (target, framebuffer), State) \
+   X(void, BindTexture, (GLenum target, GLuint texture), (target, texture), State) \
+   X(void, BindVertexArray, (GLuint array), (array), State) \
+   X(void, BindVertexBuffer, (GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride), (bindingindex, buffer, offset, stride), State) \
+   X(void, BlendFunc, (GLenum sfactor, GLenum dfactor), (sfactor, dfactor), State) \
+   X(void, BlitNamedFramebuffer, (GLuint readFramebuffer, GLuint drawFramebuffer, GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter), (readFramebuffer, drawFramebuffer, srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter), Plain) \
+   X(void, BufferData, (GLenum target, GLsizeiptr size, const void *data, GLenum usage), (target, size, data, usage), Custom) \
+   X(void, BufferStorage, (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags), (target, size, data, flags), Custom) \
+   X(void, BufferSubData, (GLenum target, GLintptr offset, GLsizeiptr size, const void *data), (target, offset, size, data), Custom) \
+   X(GLenum, CheckNamedFramebufferStatus, (GLuint framebuffer, GLenum target), (framebuffer, target), Custom) \
+   X(void, Clear, (GLbitfield mask), (mask), Plain) \
+   X(void, ClearColor, (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha), (red, green, blue, alpha), State) \
+   X(GLenum, ClientWaitSync, (GLsync sync, GLbitfield flags, GLuint64 timeout), (sync, flags, timeout), Custom) \
+   X(void, ColorMask, (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha), (red, green, blue, alpha), State) \
+   X(void, CompileShader, (GLuint shader), (shader), Plain) \
+   X(void, CopyBufferSubData, (GLenum readtarget, GLenum writetarget, GLintptr readoffset, GLintptr writeoffset, GLsizeiptr size), (readtarget, writetarget, readoffset, writeoffset, size), Plain) \
+   X(void, CreateFramebuffers, (GLsizei n, GLuint *framebuffers), (n, framebuffers), Custom) \
+   X(GLuint, CreateProgram, (), (), Custom) \
+   X(void, CreateRenderbuffers, (GLsizei n, GLuint *renderbuffers), (n, renderbuffers), Custom) \
+   X(GLuint, CreateShader, (GLenum type), (type), Custom) \
+   X(void, CreateTextures, (GLenum target, GLsizei n, GLuint *textures), (target, n, textures), Custom) \
+   X(void, DeleteBuffers, (GLsizei n, const GLuint *buffers), (n, buffers), Custom) \
+   X(void, DeleteFramebuffers, (GLsizei n, const GLuint *framebuffers), (n, framebuffers), Plain) \
+   X(void, DeleteRenderbuffers, (GLsizei n, const GLuint *renderbuffers), (n, renderbuffers), Plain) \
+   X(void, DeleteSync, (GLsync sync), (sync), Plain) \
+   X(void, DeleteTextures, (GLsizei n, const GLuint *textures), (n, textures), Plain) \
+   X(void, DeleteVertexArrays, (GLsizei n, const GLuint *arrays), (n, arrays), Plain) \
+   X(void, DepthFunc, (GLenum func), (func), State) \
+   X(void, DepthMask, (GLboolean flag), (flag), State) \
+   X(void, Disable, (GLenum cap), (cap), State) \
+   X(void, DisableVertexAttribArray, (GLuint index), (index), Plain) \
+   X(void, DrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count), Draw) \
+   X(void, DrawArraysInstanced, (GLenum mode, GLint first, GLsizei count, GLsizei primcount), (mode, first, count, primcount), Draw) \
+   X(void, DrawElementsBaseVertex, (GLenum mode, GLsizei count, GLenum type, const void *indices, GLint basevertex), (mode, count, type, indices, basevertex), Draw) \
+   X(void, DrawElementsInstancedBaseVertex, (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei primcount, GLint basevertex), (mode, count, type, indices, primcount, basevertex), Draw) \
+   X(void, Enable, (GLenum cap), (cap), State) \
+   X(void, EnableVertexAttribArray, (GLuint index), (index), Plain) \
+   X(GLsync, FenceSync, (GLenum condition, GLbitfield flags), (condition, flags), Custom) \
+   X(void, Finish, (), (), Plain) \
+   X(void, GenBuffers, (GLsizei n, GLuint *buffers), (n, buffers), Custom) \
+   X(void, GenQueries, (GLsizei n, GLuint *ids), (n, ids), Custom) \
+   X(void, GenTextures, (GLsizei n, GLuint *textures), (n, textures), Custom) \
+   X(void, GenVertexArrays, (GLsizei n, GLuint *arrays), (n, arrays), Custom) \
+   X(void, GetActiveUniform, (GLuint program, GLuint index, GLsizei maxLength, GLsizei *length, GLint *size, GLenum *type, GLchar *name), (program, index, maxLength, length, size, type, name), Custom) \
+   X(GLenum, GetError, (), (), Plain) \
+   X(void, GetInteger64v, (GLenum pname, GLint64 *params), (pname, params), Custom) \
+   X(void, GetIntegerv, (GLenum pname, GLint *params), (pname, params), Custom) \
+   X(void, GetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei *length, GLchar *infoLog), (program, bufSize, length, infoLog), Custom) \
+   X(void, GetProgramiv, (GLuint program, GLenum pname, GLint *param), (program, pname, param), Custom) \
+   X(void, GetQueryObjectiv, (GLuint id, GLenum pname, GLint *params), (id, pname, params), Custom) \
+   X(void, GetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64 *params), (id, pname, params), Custom) \
+   X(void, GetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog), (shader, bufSize, length, infoLog), Custom) \
+   X(void, GetShaderSource, (GLuint shader, GLsizei maxLength, GLsizei *length, GLchar *source), (shader, maxLength, length, source), Custom) \
+   X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint *param), (shader, pname, param), Custom) \
+   X(GLint, GetUniformLocation, (GLuint program, const GLchar *name), (program, name), Custom) \
+   X(void, LineWidth, (GLfloat width), (width), State) \
+   X(void, LinkProgram, (GLuint program), (program), Custom) \
+   X(void *, MapBufferRange, (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access), (target, offset, length, access), Custom) \
+   X(void, MultiDrawArraysIndirect, (GLenum mode, const void *indirect, GLsizei primcount, GLsizei stride), (mode, indirect, primcount, stride), Draw) \
+   X(void, MultiDrawElementsIndirect, (GLenum mode, GLenum type, const void *indirect, GLsizei primcount, GLsizei stride), (mode, type, indirect, primcount, stride), Draw) \
+   X(void, NamedFramebufferRenderbuffer, (GLuint framebuffer, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer), (framebuffer, attachment, renderbuffertarget, renderbuffer), Plain) \
+   X(void, NamedFramebufferTexture, (GLuint framebuffer, GLenum attachment, GLuint texture, GLint level), (framebuffer, attachment, texture, level), Plain) \
+   X(void, NamedRenderbufferStorage, (GLuint renderbuffer, GLenum internalformat, GLsizei width, GLsizei height), (renderbuffer, internalformat, width, height), Plain) \
+   X(void, PixelStorei, (GLenum pname, GLint param), (pname, param), State) \
+   X(void, PointSize, (GLfloat size), (size), State) \
+   X(void, PolygonMode, (GLenum face, GLenum mode), (face, mode), State) \
+   X(void, QueryCounter, (GLuint id, GLenum target), (id, target), Plain) \
+   X(void, ShaderSource, (GLuint shader, GLsizei count, const GLchar *const *string, const GLint *length), (shader, count, string, length), Custom) \
+   X(void, TexEnvf, (GLenum target, GLenum pname, GLfloat param), (target, pname, param), State) \
+   X(void, TexImage2D, (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void *pixels), (target, level, internalformat, width, height, border, format, type, pixels), Custom) \
+   X(void, TexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param), Plain) \
+   X(void, TextureParameteri, (GLuint texture, GLenum pname, GLint param), (texture, pname, param), Plain) \
+   X(void, TextureStorage2D, (GLuint texture, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height), (texture, levels, internalformat, width, height), Plain) \
+   X(void, Uniform1i, (GLint location, GLint v0), (location, v0), Custom) \
+   X(void, Uniform2fv, (GLint location, GLsizei count, const GLfloat *value), (location, count, value), Custom) \
+   X(void, Uniform4fv, (GLint location, GLsizei count, const GLfloat *value), (location, count, value), Custom) \
+   X(void, UniformMatrix4fv, (GLint location, GLsizei count, GLboolean transpose, const GLfloat *value), (location, count, transpose, value), Custom) \
+   X(GLboolean, UnmapBuffer, (GLenum target), (target), Custom) \
+   X(void, UseProgram, (GLuint program), (program), State) \
+   X(void, VertexArrayElementBuffer, (GLuint vaobj, GLuint buffer), (vaobj, buffer), Plain) \
+   X(void, VertexArrayVertexBuffer, (GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride), (vaobj, bindingindex, buffer, offset, stride), Plain) \
+   X(void, VertexAttribBinding, (GLuint attribindex, GLuint bindingindex), (attribindex, bindingindex), Plain) \
+   X(void, VertexAttribDivisor, (GLuint index, GLuint divisor), (index, divisor), Plain) \
+   X(void, VertexAttribFormat, (GLuint attribindex, GLint size, GLenum type, GLboolean normalized, GLuint relativeoffset), (attribindex, size, type, normalized, relativeoffset), Plain) \
+   X(void, VertexAttribPointer, (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer), (index, size, type, normalized, stride, pointer), Plain) \
+   X(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), State)
+
+namespace gl {
+
+#define RSR_GL_POINTER(ret, name, params, args, kind) ret (GLAPIENTRY *name) params;
+   struct Dispatch {
+      RSR_GL_FUNCTIONS(RSR_GL_POINTER)
+   };
+#undef RSR_GL_POINTER
+
+   extern Dispatch table;
+
+#define RSR_GL_WRAPPER(ret, name, params, args, kind) inline ret name params { return table.name args; }
+   RSR_GL_FUNCTIONS(RSR_GL_WRAPPER)
+#undef RSR_GL_WRAPPER
+
+#define RSR_GL_INDEX(ret, name, params, args, kind) Fn_##name,
+   enum Function : size_t {
+      RSR_GL_FUNCTIONS(RSR_GL_INDEX)
+      FunctionCount
+   };
+#undef RSR_GL_INDEX
+
+   enum class Backend {
+      Driver,
+      Null
+   };
+
+   //pick before the renderer starts, the window should then be created with Window::NO_CONTEXT
+   void setBackend(Backend backend);
+   Backend getBackend();
+
+   //fills the table, called by the renderer once the context is current
+   void load();
+
+   //only the null backend counts, from whatever thread the gl calls come from
+   struct Counters {
+      size_t calls[FunctionCount];
+      size_t drawCalls;
+      size_t stateChanges;
+
+      //buffer and texture data and uniforms handed over by pointer, writes to mapped memory don't show up
+      size_t bytesUploaded;
+
+      size_t totalCalls() const;
+   };
+
+   //a copy of the counts so far, safe while the render thread keeps calling gl
+   Counters getCounters();
+   void resetCounters();
+   const char *getName(Function function);
+}
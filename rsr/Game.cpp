@@ -1,9 +1,13 @@
 #include "Game.hpp"
 #include "Camera.hpp"
 #include "CubeMap.hpp"
+#include "DrawList.hpp"
+#include "DynamicResolution.hpp"
+#include "Profiler.hpp"
 #include "Track.hpp"
 
 #include <algorithm>
+#include <float.h>
 
 namespace Shaders {
    static Shader *Skybox = nullptr;
@@ -14,6 +18,9 @@ namespace Shaders {
    static Shader *Bunny = nullptr;
    static Shader *Shell = nullptr;
    static Shader *Track = nullptr;
+   static Shader *LitBatch = nullptr;
+   static Shader *Upscale = nullptr;
+   static DepthPrepassShaders Depth;
 
    static void build() {
       Skybox = ShaderManager::create("assets/skybox.glsl");
@@ -24,12 +31,20 @@ namespace Shaders {
       Bunny = ShaderManager::create("assets/shaders.glsl", DiffuseLighting | Rotation);
       Shell = ShaderManager::create("assets/shaders.glsl", ColorAttribute | Rotation);
       Track = ShaderManager::create("assets/shaders.glsl", DiffuseLighting);
+      LitBatch = ShaderManager::create("assets/shaders.glsl", DiffuseLighting | Instanced);
+      Upscale = ShaderManager::create("assets/upscale.glsl");
+
+      Depth.shader = ShaderManager::create("assets/depth.glsl");
+      Depth.rotationShader = ShaderManager::create("assets/depth.glsl", Rotation);
+      Depth.batchShader = ShaderManager::create("assets/depth.glsl", Instanced);
    }
 }
 
 struct BunnyModel {
    ModelVertices vertices;
    Model *renderModel;
+   ModelLOD lod;
+   OccluderMesh occluder;
    QuickHullTestModels hullModels;
 };
 
@@ -96,9 +111,6 @@ struct Bunny {
 
       debugLines[BackAxis].pos3 = vec::add(backCenter, vec::mul(axis, 0.15f));
       debugLines[BackAxis + 1].pos3 = vec::sub(backCenter, vec::mul(axis, 0.15f));
-
-
-      ModelManager::updateData(debugLinesModel, debugLines);
    }
 
    void updateThrottle() {
@@ -198,6 +210,7 @@ class Game::Impl {
    float m_axisScale = 10.0f;
 
    Model *m_skybox, *m_testTrack, *m_axisLines;
+   OccluderMesh m_testTrackOccluder;
    UBO *m_testUBO;
    CubeMap *m_cubemap;
    TestUBO m_u;
@@ -207,6 +220,16 @@ class Game::Impl {
    BunnyModel m_bunnyModel;
    Bunny m_bunny;
 
+   DrawList m_drawList;
+   bool m_depthPrepass = false;
+   OcclusionCuller m_occlusion;
+   bool m_occlusionCulling = true;
+
+   //the scene renders at whatever scale keeps the gpu near 60fps and gets stretched over the window
+   std::unique_ptr<DynamicResolution> m_resolution;
+   bool m_dynamicResolution = true;
+   bool m_sharpen = true;
+
    int qhIterCount = 1000;
 
    void buildBunnyModel() {
@@ -233,7 +256,11 @@ class Game::Impl {
 
 
          m_bunnyModel.vertices = vs.calculateNormals();
-         m_bunnyModel.renderModel = vs.expandIndices().createModel(ModelOpts::IncludeNormals);
+         auto chain = buildLODChain(vs, { 0.5f, 0.25f, 0.1f });
+         m_bunnyModel.lod = ModelLOD::create(chain, ModelOpts::IncludeNormals);
+         //the coarsest level is plenty to hide things behind
+         m_bunnyModel.occluder = { chain.back().vertices.positions, chain.back().indices };
+         m_bunnyModel.renderModel = m_bunnyModel.lod.models[0];
 
          
       }
@@ -271,7 +298,7 @@ class Game::Impl {
    void buildSkybox() {
       auto vertexSet = ModelVertices::fromOBJ("assets/myshittyskybox.obj");
       if (!vertexSet.empty()) {
-         m_skybox = vertexSet[0].expandIndices().createModel();
+         m_skybox = vertexSet[0].createIndexedModel();
       }
 
       m_cubemap = CubeMapManager::create({
@@ -293,7 +320,9 @@ class Game::Impl {
          { { -50.0f, 0.0f, -50.0f },   0.0f, 10.0f }
       };
 
-      m_testTrack = createTrackSegment(pointList, true);
+      auto segment = buildTrackSegment(pointList, true);
+      m_testTrackOccluder = OccluderMesh::fromVertices(segment);
+      m_testTrack = createTrackSegment(std::move(segment));
    }
    
    void buildCamera() {
@@ -336,10 +365,15 @@ public:
 
       buildBunnyModel();
       buildBunny();
+
+      m_drawList.setOcclusionCuller(&m_occlusion);
+
+      m_resolution.reset(new DynamicResolution(16.0));
+      m_resolution->setUpscaleShader(Shaders::Upscale, 0.2f);
    }
 
    void onShutdown() {
-
+      m_resolution.reset();
    }
 
    void updateKeyboard(Keyboard *k) {
@@ -348,18 +382,48 @@ public:
          case Keys::Key_Escape:
             m_window->close();
             break;
+         case Keys::Key_F12:
+            if (ke->action == KeyActions::Key_Pressed) {
+               m_renderer.captureFrame("frame.rsrtrace");
+            }
+            break;
+         case Keys::Key_F11:
+            if (ke->action == KeyActions::Key_Pressed) {
+               PROFILE_EXPORT("profile.json");
+            }
+            break;
+         case Keys::Key_F10:
+            if (ke->action == KeyActions::Key_Pressed) {
+               m_depthPrepass = !m_depthPrepass;
+               m_drawList.setDepthPrepass(m_depthPrepass ? Shaders::Depth : DepthPrepassShaders());
+            }
+            break;
+         case Keys::Key_F9:
+            if (ke->action == KeyActions::Key_Pressed) {
+               m_occlusionCulling = !m_occlusionCulling;
+               m_drawList.setOcclusionCuller(m_occlusionCulling ? &m_occlusion : nullptr);
+            }
+            break;
+         case Keys::Key_F8:
+            if (ke->action == KeyActions::Key_Pressed) {
+               m_dynamicResolution = !m_dynamicResolution;
+            }
+            break;
+         case Keys::Key_F7:
+            if (ke->action == KeyActions::Key_Pressed) {
+               m_sharpen = !m_sharpen;
+               m_resolution->setUpscaleShader(m_sharpen ? Shaders::Upscale : nullptr, 0.2f);
+            }
+            break;
+         //only the hull test reads qhIterCount, the lod chain doesn't depend on it and gets built once at startup
          case Keys::Key_KeypadAdd:
             if (ke->action == KeyActions::Key_Pressed) {
-               
                qhIterCount += 1;
-               buildBunnyModel();
             }
-            
             break;
          case Keys::Key_KeypadSubtract:
             if (ke->action == KeyActions::Key_Pressed && qhIterCount > 0) {
                qhIterCount--;
-               buildBunnyModel();
             }
             break;
          }
@@ -395,6 +459,8 @@ public:
    }
 
    void update() {
+      PROFILE_ZONE("Game::update");
+
       static int j = 0;
 
       m_bunny.update();
@@ -406,21 +472,18 @@ public:
    }
 
    void render() {
-      Renderer &r = m_renderer;
-
-      auto uModel = internString("uModelMatrix");
-      auto uModelRotation = internString("uModelRotation");
-      auto uColor = internString("uColorTransform");
-      auto uTexture = internString("uTexMatrix");
-      auto uTextureSlot = internString("uTexture");
-      auto uSkyboxSlot = internString("uSkybox");
+      PROFILE_ZONE("Game::render");
 
-      
-
-      Matrix texTransform = Matrix::identity();
+      Renderer &r = m_renderer;
 
+      static auto uSkyboxSlot = ShaderManager::getUniformHandle(internString("uSkybox"));
 
-      r.viewport({ 0, 0, (int)r.getWidth(), (int)r.getHeight() });
+      if (m_dynamicResolution) {
+         m_resolution->begin(r);
+      }
+      else {
+         r.viewport({ 0, 0, (int)r.getWidth(), (int)r.getHeight() });
+      }
       r.clear(CommonColors::Black);
 
       TestUBO cameraUbo;
@@ -444,34 +507,50 @@ public:
       m_u.ambient = 0.1f;
 
       r.setUBOData(m_testUBO, m_u);
-      r.enableAlphaBlending(true);
 
-      r.setShader(Shaders::Lines);
-      r.setMatrix(uModel, Matrix::scale3f(vec::mul({ 1.0f, 1.0f, 1.0f }, m_axisScale)));
-      r.setColor(uColor, CommonColors::White);
-      r.renderModel(m_axisLines, ModelManager::Lines);
+      auto &dl = m_drawList;
+      dl.clear();
 
+      DrawItem axis;
+      axis.shader = Shaders::Lines;
+      axis.model = m_axisLines;
+      axis.renderType = ModelManager::Lines;
+      axis.transform = Matrix::scale3f(vec::mul({ 1.0f, 1.0f, 1.0f }, m_axisScale));
+      dl.push(axis);
 
       auto c = m_bunny.color;
       //c.a = 0.5f;
 
-      r.setShader(Shaders::Bunny);
-      r.setMatrix(uModel, m_bunny.modelMatrix);
-      r.setMatrix(uModelRotation, m_bunny.rotation);
-      r.setColor(uColor, c);
-      r.renderModel(m_bunnyModel.renderModel);
-
-      r.setShader(Shaders::Lines);
-
-      r.setMatrix(uModel, m_bunny.debugLinesMatrix);
-      r.setColor(uColor, CommonColors::White);
-      r.renderModel(m_bunny.debugLinesModel, ModelManager::Lines);
-
-
-      r.setShader(Shaders::Track);
-      r.setMatrix(uModel, Matrix::identity());
-      r.setColor(uColor, CommonColors::DkGray);
-      r.renderModel(m_testTrack);
+      DrawItem bunny;
+      bunny.shader = Shaders::Bunny;
+      bunny.batchShader = Shaders::LitBatch;
+      bunny.model = m_bunnyModel.renderModel;
+      bunny.lod = &m_bunnyModel.lod;
+      bunny.transform = m_bunny.modelMatrix;
+      bunny.rotation = m_bunny.rotation;
+      bunny.hasRotation = true;
+      bunny.color = c;
+      bunny.occluder = &m_bunnyModel.occluder;
+      dl.push(bunny);
+
+      r.updateModelData(m_bunny.debugLinesModel, m_bunny.debugLines);
+
+      DrawItem debugLines;
+      debugLines.shader = Shaders::Lines;
+      debugLines.model = m_bunny.debugLinesModel;
+      debugLines.renderType = ModelManager::Lines;
+      debugLines.transform = m_bunny.debugLinesMatrix;
+      dl.push(debugLines);
+
+      DrawItem track;
+      track.shader = Shaders::Track;
+      track.batchShader = Shaders::LitBatch;
+      track.model = m_testTrack;
+      track.color = CommonColors::DkGray;
+      track.occluder = &m_testTrackOccluder;
+      dl.push(track);
+
+      dl.submit(r, m_u.view);
 
       //r.enableDepth(false);
 
@@ -520,13 +599,16 @@ public:
 
       r.enableAlphaBlending(false);
 
-      
+      if (m_dynamicResolution) {
+         m_resolution->end(r);
+      }
 
       r.finish();
-      r.flush();
    }
 
    void onStep() {
+      PROFILE_ZONE("Game::onStep");
+
       update();
       render();
    }
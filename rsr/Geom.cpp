@@ -3,6 +3,11 @@
 #include <math.h>
 #include <algorithm>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define RSR_SSE
+#include <xmmintrin.h>
+#endif
+
 Matrix Matrix::identity() {
    Matrix out = { 0 };
    out[0] = 1.0f;
@@ -470,3 +475,72 @@ Spherical vec::toSpherical(Float3 const &v) {
    return out;
 }
 
+//gribb/hartmann, each plane is the w row plus or minus one of the others
+Frustum Frustum::fromMatrix(Matrix const &viewProj) {
+   auto row = [&](int r, int c) { return viewProj[c * 4 + r]; };
+
+   Frustum out;
+   for (int p = 0; p < PlaneCount; ++p) {
+      int axis = p / 2;
+      float sign = (p & 1) ? -1.0f : 1.0f;
+
+      float plane[4];
+      for (int c = 0; c < 4; ++c) {
+         plane[c] = row(3, c) + sign * row(axis, c);
+      }
+
+      float len = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+      if (len > 0.0f) {
+         for (auto && f : plane) {
+            f /= len;
+         }
+      }
+
+      out.nx[p] = plane[0];
+      out.ny[p] = plane[1];
+      out.nz[p] = plane[2];
+      out.d[p] = plane[3];
+   }
+
+   return out;
+}
+
+void Frustum::testSpheres(float const *x, float const *y, float const *z, float const *radius, size_t count, uint8_t *visible) const {
+   size_t i = 0;
+
+#ifdef RSR_SSE
+   //four spheres against one plane at a time
+   for (; i + 4 <= count; i += 4) {
+      __m128 px = _mm_loadu_ps(x + i);
+      __m128 py = _mm_loadu_ps(y + i);
+      __m128 pz = _mm_loadu_ps(z + i);
+      __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+
+      auto planeTest = [&](int p) {
+         __m128 dist = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(nx[p])), _mm_mul_ps(py, _mm_set1_ps(ny[p]))),
+            _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(nz[p])), _mm_set1_ps(d[p])));
+         return _mm_cmpge_ps(dist, negRadius);
+      };
+
+      __m128 inside = planeTest(0);
+      for (int p = 1; p < PlaneCount; ++p) {
+         inside = _mm_and_ps(inside, planeTest(p));
+      }
+
+      int mask = _mm_movemask_ps(inside);
+      visible[i + 0] = (uint8_t)(mask & 1);
+      visible[i + 1] = (uint8_t)((mask >> 1) & 1);
+      visible[i + 2] = (uint8_t)((mask >> 2) & 1);
+      visible[i + 3] = (uint8_t)((mask >> 3) & 1);
+   }
+#endif
+
+   for (; i < count; ++i) {
+      bool inside = true;
+      for (int p = 0; p < PlaneCount && inside; ++p) {
+         inside = nx[p] * x[i] + ny[p] * y[i] + nz[p] * z[i] + d[p] >= -radius[i];
+      }
+      visible[i] = inside ? 1 : 0;
+   }
+}
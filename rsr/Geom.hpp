@@ -1,5 +1,8 @@
 #pragma once
 
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <vector>
 
 static const float PI = 3.14159265359f;
@@ -193,6 +196,28 @@ struct Quaternion {
    Float3 rotate(Float3 &pt);
 };
 
+struct AABB {
+   Float3 min, max;
+};
+
+struct Sphere {
+   Float3 center;
+   float radius;
+};
+
+// Clip planes of a view-projection matrix, normalized with the normals pointing inward
+// a point p is on the inside of plane i when nx[i] * p.x + ny[i] * p.y + nz[i] * p.z + d[i] >= 0
+struct Frustum {
+   enum { Left, Right, Bottom, Top, Near, Far, PlaneCount };
+
+   float nx[PlaneCount], ny[PlaneCount], nz[PlaneCount], d[PlaneCount];
+
+   static Frustum fromMatrix(Matrix const &viewProj);
+
+   //spheres as separate arrays, visible[i] becomes 1 when sphere i is at least partly inside, 0 otherwise
+   void testSpheres(float const *x, float const *y, float const *z, float const *radius, size_t count, uint8_t *visible) const;
+};
+
 
 
 
@@ -0,0 +1,245 @@
+#ifndef _WIN32
+
+#include "GL/glew.h"
+#include "Window.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <stdio.h>
+#include <vector>
+
+// Window for machines without a display or a gpu
+//
+// The context comes from EGL without any surface (EGL_MESA_platform_surfaceless, fine on llvmpipe) and
+// everything meant for the screen is drawn into an offscreen framebuffer. swapBuffers waits on a fence
+// from the frame before, like a two buffer swap chain would, or with READBACK copies the frame out.
+// Input never fires, the loop ends through close().
+class Window::Impl {
+   EGLDisplay m_display = EGL_NO_DISPLAY;
+   EGLContext m_context = EGL_NO_CONTEXT;
+
+   GLuint m_framebuffer = 0, m_color = 0, m_depth = 0;
+   GLsync m_lastFrame = nullptr;
+   std::vector<unsigned char> m_pixels;
+
+   size_t m_width = 0, m_height = 0;
+   int m_flags = 0;
+   bool m_shouldClose = false;
+
+   Keyboard *m_keyboard = nullptr;
+   Mouse *m_mouse = nullptr;
+
+   static EGLDisplay openDisplay() {
+      //surfaceless needs neither a gpu nor a display server, anything else is a fallback
+      auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (getPlatformDisplay) {
+         auto display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+         if (display != EGL_NO_DISPLAY) {
+            return display;
+         }
+      }
+
+      return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+   }
+
+   //4.5 is what the renderer needs, compatibility matches what wgl hands out
+   bool createContext() {
+      EGLint configAttrs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+      EGLConfig config = nullptr;
+      EGLint configCount = 0;
+      if (!eglChooseConfig(m_display, configAttrs, &config, 1, &configCount) || !configCount) {
+         config = nullptr; //EGL_NO_CONFIG_KHR, fine since nothing ever gets a surface
+      }
+
+      EGLint profiles[] = { EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT };
+      for (auto profile : profiles) {
+         EGLint contextAttrs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 5,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, profile,
+            EGL_NONE };
+
+         m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttrs);
+         if (m_context != EGL_NO_CONTEXT) {
+            return true;
+         }
+      }
+
+      return false;
+   }
+
+   void createFramebuffer() {
+      glGenRenderbuffers(1, &m_color);
+      glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, (GLsizei)m_width, (GLsizei)m_height);
+
+      glGenRenderbuffers(1, &m_depth);
+      glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, (GLsizei)m_width, (GLsizei)m_height);
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+      //stays bound, there's no default framebuffer to fall back to
+      glGenFramebuffers(1, &m_framebuffer);
+      glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+      glViewport(0, 0, (GLsizei)m_width, (GLsizei)m_height);
+   }
+
+public:
+   ~Impl() {
+      if (m_context != EGL_NO_CONTEXT) {
+         eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+         eglDestroyContext(m_display, m_context);
+      }
+      if (m_display != EGL_NO_DISPLAY) {
+         eglTerminate(m_display);
+      }
+
+      Mouse::destroy(m_mouse);
+      Keyboard::destroy(m_keyboard);
+   }
+
+   int create(size_t width, size_t height, const char *title, int flags) {
+      m_width = width;
+      m_height = height;
+      m_flags = flags;
+
+      m_keyboard = Keyboard::create();
+      m_mouse = Mouse::create([]() { return Int2{ 0, 0 }; });
+
+      //the null backend runs without EGL, so it works even where there's no Mesa
+      if (flags & NO_CONTEXT) {
+         return 0;
+      }
+
+      m_display = openDisplay();
+
+      EGLint major, minor;
+      if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+         fprintf(stderr, "%s: no EGL display\n", title);
+         return 1;
+      }
+
+      return 0;
+   }
+
+   bool shouldClose() { return m_shouldClose; }
+   void pollEvents() {}
+
+   size_t getWidth() { return m_width; }
+   size_t getHeight() { return m_height; }
+
+   int beginRender() {
+      if (m_flags & NO_CONTEXT) {
+         return 0;
+      }
+
+      //the bound api is per thread and defaults to GLES
+      if (!eglBindAPI(EGL_OPENGL_API)) {
+         fprintf(stderr, "EGL can't do desktop GL\n");
+         return 1;
+      }
+
+      //the context already exists, just take it over
+      if (m_context != EGL_NO_CONTEXT) {
+         eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context);
+         return 0;
+      }
+
+      if (!createContext()) {
+         fprintf(stderr, "failed to create a GL 4.5 context\n");
+         return 1;
+      }
+
+      if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+         fprintf(stderr, "failed to make the context current without a surface\n");
+         return 1;
+      }
+
+      glewInit();
+      createFramebuffer();
+      return 0;
+   }
+
+   void endRender() {
+      if (m_flags & NO_CONTEXT) {
+         return;
+      }
+
+      eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+   }
+
+   void swapBuffers() {
+      if (m_flags & NO_CONTEXT) {
+         return;
+      }
+
+      if (m_flags & READBACK) {
+         m_pixels.resize(m_width * m_height * 4);
+         glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+         glReadPixels(0, 0, (GLsizei)m_width, (GLsizei)m_height, GL_RGBA, GL_UNSIGNED_BYTE, m_pixels.data());
+         return;
+      }
+
+      //keeps one frame in flight, a swap chain would block the same way
+      if (m_lastFrame) {
+         glClientWaitSync(m_lastFrame, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+         glDeleteSync(m_lastFrame);
+      }
+      m_lastFrame = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   }
+
+   unsigned int getFramebuffer() { return m_framebuffer; }
+   unsigned char const *getPixels() { return m_pixels.empty() ? nullptr : m_pixels.data(); }
+
+   Mouse *getMouse() { return m_mouse; }
+   Keyboard *getKeyboard() { return m_keyboard; }
+
+   void close() {
+      m_shouldClose = true;
+   }
+};
+
+Window::Window() :pImpl(new Impl()) { }
+Window::~Window() {}
+
+bool Window::shouldClose() { return pImpl->shouldClose(); }
+void Window::pollEvents() { pImpl->pollEvents(); }
+
+size_t  Window::getWidth() { return pImpl->getWidth(); }
+size_t  Window::getHeight() { return pImpl->getHeight(); }
+
+int  Window::beginRender() { return pImpl->beginRender(); }
+void  Window::endRender() { pImpl->endRender(); }
+void  Window::swapBuffers() { pImpl->swapBuffers(); }
+
+unsigned int Window::getFramebuffer() { return pImpl->getFramebuffer(); }
+unsigned char const *Window::getPixels() { return pImpl->getPixels(); }
+
+Mouse *Window::getMouse() { return pImpl->getMouse(); }
+Keyboard *Window::getKeyboard() { return pImpl->getKeyboard(); }
+
+Window *Window::create(size_t width, size_t height, const char *title, int flags) {
+   auto out = new Window();
+
+   if (out->pImpl->create(width, height, title, flags)) {
+      destroy(out);
+      return nullptr;
+   }
+
+   return out;
+}
+
+void Window::destroy(Window *wnd) {
+   if (wnd) {
+      delete wnd;
+   }
+}
+
+void Window::close() {
+   pImpl->close();
+}
+
+#endif
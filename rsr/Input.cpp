@@ -11,7 +11,7 @@ class Mouse::Impl {
    bool m_heldMap[MouseBtn_COUNT];
    int m_queuePos;
 public:
-   Impl(PositionGet const &posGet):m_getPos(posGet) {}
+   Impl(PositionGet const &posGet):m_getPos(posGet), m_heldMap(), m_queuePos(0) {}
    ~Impl(){}
 
    void pushEvent(MouseEvent const &e) { m_eventQueue.push_back(e); }
@@ -83,7 +83,7 @@ class Keyboard::Impl {
    }
 
 public:
-   Impl() {}
+   Impl() :m_heldMap(), m_queuePos(0) {}
    ~Impl() {}
 
    void pushEvent(KeyboardEvent const &e) { m_eventQueue.push_back(e); }
@@ -1,79 +1,611 @@
-#include "GL/glew.h"
+#include "GLDispatch.hpp"
 
 #include "Model.hpp"
 #include "Defs.hpp"
+#include "Singleton.hpp"
+#include "StreamBuffer.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <math.h>
 #include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <string.h>
+
+static GLuint getGLRenderType(ModelManager::RenderType type) {
+   static GLuint map[3];
+   static bool mapInit = false;
+   if (!mapInit) {
+      mapInit = true;
+      map[ModelManager::Triangles] = GL_TRIANGLES;
+      map[ModelManager::Lines] = GL_LINES;
+      map[ModelManager::Points] = GL_POINTS;
+   }
+
+   return map[type];
+}
 
-int vertexAttributeByteSize(VertexAttribute attr) {
+static GLint vertexAttributeComponents(VertexAttribute attr) {
    switch (attr) {
    case VertexAttribute::Tex2:
    case VertexAttribute::Pos2:
-      return sizeof(Float2);
-      break;
+      return 2;
    case VertexAttribute::Pos3:
    case VertexAttribute::Norm3:
-      return sizeof(Float3);
-      break;
+      return 3;
    case VertexAttribute::Col4:
-      return sizeof(ColorRGBAf);
-      break;
+   case VertexAttribute::InstCol4:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+static ModelManager::Bounds calculateBounds(byte const *data, size_t vertexSize, size_t vCount,
+   VertexAttribute const *attrs, int attrCount) {
+   ModelManager::Bounds out = {};
+
+   size_t offset = 0;
+   int posIndex = 0;
+   for (; posIndex < attrCount; ++posIndex) {
+      if (attrs[posIndex] == VertexAttribute::Pos3 || attrs[posIndex] == VertexAttribute::Pos2) {
+         break;
+      }
+      offset += vertexAttributeByteSize(attrs[posIndex]);
+   }
+
+   if (posIndex == attrCount || !vCount) {
+      return out;
+   }
+
+   bool is3D = attrs[posIndex] == VertexAttribute::Pos3;
+   auto position = [&](size_t i) {
+      Float3 p = { 0.0f, 0.0f, 0.0f };
+      memcpy(&p, data + i * vertexSize + offset, is3D ? sizeof(Float3) : sizeof(Float2));
+      return p;
+   };
+
+   out.box.min = out.box.max = position(0);
+   for (size_t i = 1; i < vCount; ++i) {
+      auto p = position(i);
+      out.box.min = { std::min(out.box.min.x, p.x), std::min(out.box.min.y, p.y), std::min(out.box.min.z, p.z) };
+      out.box.max = { std::max(out.box.max.x, p.x), std::max(out.box.max.y, p.y), std::max(out.box.max.z, p.z) };
    }
 
-   return 0;
+   //centered on the box, the radius reaches the farthest vertex rather than the corners
+   out.sphere.center = vec::mul(vec::add(out.box.min, out.box.max), 0.5f);
+   float radiusSq = 0.0f;
+   for (size_t i = 0; i < vCount; ++i) {
+      radiusSq = std::max(radiusSq, vec::lensq(vec::sub(position(i), out.sphere.center)));
+   }
+   out.sphere.radius = sqrtf(radiusSq);
+
+   out.valid = true;
+   return out;
+}
+
+//attribute formats for one vertex layout, worked out once and shared by every model with the same FVF
+class VertexFormat {
+public:
+   struct Attribute {
+      GLuint location;
+      GLint components;
+      GLuint offset;
+   };
+
+   std::vector<Attribute> attributes;
+   GLsizei stride;
+
+   VertexFormat(VertexAttribute const *attrs, int attrCount, size_t vertexSize) :stride((GLsizei)vertexSize) {
+      GLuint offset = 0;
+      for (int i = 0; i < attrCount; ++i) {
+         attributes.push_back({ (GLuint)attrs[i], vertexAttributeComponents(attrs[i]), offset });
+         offset += vertexAttributeByteSize(attrs[i]);
+      }
+   }
+
+   //records the formats into the bound vao, vertices come from binding 0
+   void apply() const {
+      for (auto && a : attributes) {
+         gl::EnableVertexAttribArray(a.location);
+         gl::VertexAttribFormat(a.location, a.components, GL_FLOAT, GL_FALSE, a.offset);
+         gl::VertexAttribBinding(a.location, 0);
+      }
+   }
+};
+
+//models get created from loader threads too
+class VertexFormatCache {
+   std::mutex m_mutex;
+   std::map<std::vector<unsigned int>, std::unique_ptr<VertexFormat>> m_formats;
+
+public:
+   VertexFormat const *get(VertexAttribute const *attrs, int attrCount, size_t vertexSize) {
+      std::vector<unsigned int> key;
+      key.push_back((unsigned int)vertexSize);
+      for (int i = 0; i < attrCount; ++i) {
+         key.push_back((unsigned int)attrs[i]);
+      }
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto &layout = m_formats[key];
+      if (!layout) {
+         layout.reset(new VertexFormat(attrs, attrCount, vertexSize));
+      }
+      return layout.get();
+   }
+};
+typedef Singleton<VertexFormatCache> vertexFormats;
+
+//first fit over the free ranges, kept sorted by offset so neighbours merge when freed
+class RangeAllocator {
+   struct Range {
+      size_t offset, size;
+   };
+
+   std::vector<Range> m_free;
+   size_t m_capacity = 0;
+
+public:
+   size_t capacity() const { return m_capacity; }
+
+   //false when no free range is big enough, grow() and try again
+   bool alloc(size_t size, size_t *offset) {
+      for (size_t i = 0; i < m_free.size(); ++i) {
+         auto &r = m_free[i];
+         if (r.size >= size) {
+            *offset = r.offset;
+            r.offset += size;
+            r.size -= size;
+            if (!r.size) {
+               m_free.erase(m_free.begin() + i);
+            }
+            return true;
+         }
+      }
+      return false;
+   }
+
+   void free(size_t offset, size_t size) {
+      if (!size) {
+         return;
+      }
+
+      auto it = m_free.begin();
+      while (it != m_free.end() && it->offset < offset) {
+         ++it;
+      }
+      it = m_free.insert(it, { offset, size });
+
+      auto next = it + 1;
+      if (next != m_free.end() && it->offset + it->size == next->offset) {
+         it->size += next->size;
+         m_free.erase(next);
+      }
+      if (it != m_free.begin()) {
+         auto prev = it - 1;
+         if (prev->offset + prev->size == it->offset) {
+            prev->size += it->size;
+            m_free.erase(it);
+         }
+      }
+   }
+
+   //the new space goes on the end
+   void grow(size_t capacity) {
+      size_t old = m_capacity;
+      m_capacity = capacity;
+      free(old, capacity - old);
+   }
+};
+
+// Every Static model with the same vertex layout and index size lives in one vertex buffer and one index buffer
+// They share the arena's vao and only differ in their base vertex and first index, which is what lets
+// ModelManager::drawBatch hand all of them to a single multi draw. Models pick their arena when they're
+// created, the gl side and the allocators are only touched from the gl thread. Models can be destroyed
+// anywhere though, their slices come back through ModelGarbage.
+class StaticArena {
+public:
+   struct Slice {
+      size_t baseVertex, firstIndex;
+   };
+
+private:
+   static const size_t MinVertices = 0x10000;
+
+   int m_id;
+   VertexFormat const *m_layout;
+   size_t m_indexSize;
+
+   GLuint m_vao = 0, m_vbo = 0, m_ibo = 0;
+   RangeAllocator m_vertices, m_indices;
+
+   //copies the old contents over, the old buffer is gone afterwards
+   static void resize(GLuint &buffer, size_t oldSize, size_t newSize) {
+      GLuint grown;
+      gl::GenBuffers(1, &grown);
+      gl::BindBuffer(GL_COPY_WRITE_BUFFER, grown);
+      gl::BufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+
+      if (buffer) {
+         gl::BindBuffer(GL_COPY_READ_BUFFER, buffer);
+         gl::CopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+         gl::BindBuffer(GL_COPY_READ_BUFFER, 0);
+         gl::DeleteBuffers(1, &buffer);
+      }
+
+      gl::BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      buffer = grown;
+   }
+
+   static size_t grownCapacity(RangeAllocator const &a, size_t needed) {
+      //std::max takes references, a copy keeps MinVertices from needing a definition
+      size_t minimum = MinVertices;
+      size_t capacity = std::max(a.capacity() * 2, minimum);
+      return std::max(capacity, a.capacity() + needed);
+   }
+
+   static void upload(GLuint buffer, size_t offset, size_t size, void const *data) {
+      gl::BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      gl::BufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+      gl::BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+   }
+
+public:
+   StaticArena(int id, VertexFormat const *layout, size_t indexSize) :m_id(id), m_layout(layout), m_indexSize(indexSize) {}
+
+   int getID() const { return m_id; }
+   size_t getIndexSize() const { return m_indexSize; }
+
+   GLuint getVAO() {
+      if (!m_vao) {
+         gl::GenVertexArrays(1, &m_vao);
+         gl::BindVertexArray(m_vao);
+         m_layout->apply();
+      }
+      return m_vao;
+   }
+
+   Slice alloc(void const *vertices, size_t vCount, void const *indices, size_t iCount) {
+      Slice out = { 0, 0 };
+      GLuint vao = getVAO();
+
+      while (!m_vertices.alloc(vCount, &out.baseVertex)) {
+         size_t capacity = grownCapacity(m_vertices, vCount);
+         resize(m_vbo, m_vertices.capacity() * m_layout->stride, capacity * m_layout->stride);
+         m_vertices.grow(capacity);
+         gl::VertexArrayVertexBuffer(vao, 0, m_vbo, 0, m_layout->stride);
+      }
+      upload(m_vbo, out.baseVertex * m_layout->stride, vCount * m_layout->stride, vertices);
+
+      if (iCount) {
+         while (!m_indices.alloc(iCount, &out.firstIndex)) {
+            size_t capacity = grownCapacity(m_indices, iCount);
+            resize(m_ibo, m_indices.capacity() * m_indexSize, capacity * m_indexSize);
+            m_indices.grow(capacity);
+            gl::VertexArrayElementBuffer(vao, m_ibo);
+         }
+         upload(m_ibo, out.firstIndex * m_indexSize, iCount * m_indexSize, indices);
+      }
+
+      return out;
+   }
+
+   void free(Slice const &slice, size_t vCount, size_t iCount) {
+      m_vertices.free(slice.baseVertex, vCount);
+      m_indices.free(slice.firstIndex, iCount);
+   }
+};
+
+class StaticArenaCache {
+   std::mutex m_mutex;
+   std::map<std::pair<VertexFormat const*, size_t>, std::unique_ptr<StaticArena>> m_arenas;
+
+public:
+   StaticArena *get(VertexFormat const *layout, size_t indexSize) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto &arena = m_arenas[std::make_pair(layout, indexSize)];
+      if (!arena) {
+         arena.reset(new StaticArena((int)m_arenas.size(), layout, indexSize));
+      }
+      return arena.get();
+   }
+};
+typedef Singleton<StaticArenaCache> staticArenas;
+
+// Whatever a destroyed model held on the gl side, ~Model runs on any thread so it all waits here for the gl thread
+// Arena slices go back as soon as they're picked up, a model's own vao, index buffer and stream are deleted
+// once the frames that could still be reading them are done
+class ModelGarbage {
+public:
+   struct Entry {
+      StaticArena *arena;
+      StaticArena::Slice slice;
+      size_t vCount, iCount;
+
+      GLuint vao, ibo;
+      std::unique_ptr<StreamBuffer> stream;
+
+      //frame the gl thread picked it up in
+      uint64_t frame;
+   };
+
+private:
+   std::mutex m_mutex;
+   std::vector<Entry> m_pending;
+
+   //gl thread only
+   std::vector<Entry> m_retired;
+
+public:
+   //any thread
+   void push(Entry entry) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending.push_back(std::move(entry));
+   }
+
+   //gl thread
+   void collect() {
+      std::vector<Entry> pending;
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         pending.swap(m_pending);
+      }
+
+      uint64_t frame = StreamBuffer::currentFrame();
+      for (auto && e : pending) {
+         if (e.arena) {
+            e.arena->free(e.slice, e.vCount, e.iCount);
+         }
+         else {
+            e.frame = frame;
+            m_retired.push_back(std::move(e));
+         }
+      }
+
+      for (size_t i = 0; i < m_retired.size();) {
+         auto &e = m_retired[i];
+         if (!StreamBuffer::isFrameDone(e.frame)) {
+            ++i;
+            continue;
+         }
+
+         if (e.vao) {
+            gl::DeleteVertexArrays(1, &e.vao);
+         }
+         if (e.ibo) {
+            gl::DeleteBuffers(1, &e.ibo);
+         }
+         e.stream.reset();
+
+         m_retired[i] = std::move(m_retired.back());
+         m_retired.pop_back();
+      }
+   }
+};
+typedef Singleton<ModelGarbage> modelGarbage;
+
+//every instanced draw streams its instances through here, orphaned on each upload
+class InstanceBuffer {
+   GLuint m_vbo = 0;
+
+public:
+   void bind(ModelInstance const *instances, size_t count) {
+      if (!m_vbo) {
+         gl::GenBuffers(1, &m_vbo);
+      }
+
+      size_t size = sizeof(ModelInstance) * count;
+      gl::BindBuffer(GL_ARRAY_BUFFER, m_vbo);
+      gl::BufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+      gl::BufferSubData(GL_ARRAY_BUFFER, 0, size, instances);
+
+      for (unsigned int col = 0; col < 4; ++col) {
+         unsigned int loc = (unsigned int)VertexAttribute::InstModel + col;
+         gl::EnableVertexAttribArray(loc);
+         gl::VertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+            (void*)(offsetof(ModelInstance, transform) + sizeof(float) * 4 * col));
+         gl::VertexAttribDivisor(loc, 1);
+      }
+
+      unsigned int colorLoc = (unsigned int)VertexAttribute::InstCol4;
+      gl::EnableVertexAttribArray(colorLoc);
+      gl::VertexAttribPointer(colorLoc, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance),
+         (void*)offsetof(ModelInstance, color));
+      gl::VertexAttribDivisor(colorLoc, 1);
+   }
+
+   //leaves the instance attributes off so regular draws never pick them up
+   void unbind() {
+      for (unsigned int loc = (unsigned int)VertexAttribute::InstModel; loc <= (unsigned int)VertexAttribute::InstCol4; ++loc) {
+         gl::DisableVertexAttribArray(loc);
+      }
+   }
+};
+typedef Singleton<InstanceBuffer> instanceBuffer;
+
+struct DrawElementsIndirectCommand {
+   GLuint count, instanceCount, firstIndex;
+   GLint baseVertex;
+   GLuint baseInstance;
+};
+
+struct DrawArraysIndirectCommand {
+   GLuint count, instanceCount, first, baseInstance;
+};
+
+//indirect draw commands are written straight into mapped memory
+static StreamRing &indirectRing() {
+   //never freed, the gl context is gone by the time statics are destroyed
+   static StreamRing *ring = new StreamRing(64 * 1024);
+   return *ring;
 }
 
 
 class Model {
+   int m_id;
    std::unique_ptr<byte[]> m_data;
-   std::unique_ptr<byte[]> m_dataNewData;
    size_t m_vertexSize;
    size_t m_vertexCount;
    ModelManager::DataStreamType m_dataType;
 
-   bool m_built, m_dirtyData;
+   bool m_built;
+
+   //Stream and Dynamic models source their vertices from here, updates land straight in mapped memory
+   std::unique_ptr<StreamBuffer> m_stream;
 
    std::vector<VertexAttribute> m_attrs;
+   VertexFormat const *m_layout;
 
-   GLuint m_vboHandle;
+   //optional, 16 bit whenever every vertex fits
+   std::unique_ptr<byte[]> m_indexData;
+   size_t m_indexSize;
+   size_t m_indexCount;
 
-   static GLuint getGLDataType(ModelManager::DataStreamType type) {
-      static GLuint map[3];
-      static bool mapInit = false;
-      if (!mapInit) {
-         mapInit = true;
-         map[ModelManager::Static] = GL_STATIC_DRAW;
-         map[ModelManager::Dynamic] = GL_DYNAMIC_DRAW;
-         map[ModelManager::Stream] = GL_STREAM_DRAW;
-      }
+   //the vao holds the attribute formats, vertex buffer and index buffer, binding the model is binding it
+   GLuint m_vao;
+   GLuint m_iboHandle;
 
-      return map[type];
-   }
+   //Static models are a slice of a shared arena and use its vao
+   StaticArena *m_arena;
+   StaticArena::Slice m_slice;
 
+   ModelManager::Bounds m_bounds;
+
+   //leaves the new vao bound
    void build() {
-      glGenBuffers(1, (GLuint*)&m_vboHandle);
-      glBindBuffer(GL_ARRAY_BUFFER, m_vboHandle);
-      glBufferData(GL_ARRAY_BUFFER, m_vertexSize * m_vertexCount, m_data.get(), getGLDataType(m_dataType));
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      if (m_arena) {
+         m_slice = m_arena->alloc(m_data.get(), m_vertexCount, m_indexData.get(), m_indexCount);
+         m_vao = m_arena->getVAO();
+         gl::BindVertexArray(m_vao);
+
+         m_built = true;
+         return;
+      }
+
+      gl::GenVertexArrays(1, &m_vao);
+      gl::BindVertexArray(m_vao);
+
+      if (!stream().hasData()) {
+         memcpy(m_stream->beginWrite(), m_data.get(), m_vertexSize * m_vertexCount);
+      }
+
+      //the element binding is vao state, it stays with the model from here on
+      if (m_indexCount) {
+         gl::GenBuffers(1, &m_iboHandle);
+         gl::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_iboHandle);
+         gl::BufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexSize * m_indexCount, m_indexData.get(), GL_STATIC_DRAW);
+      }
+
+      m_layout->apply();
+      gl::BindVertexBuffer(0, m_stream->getHandle(), m_stream->getOffset(), m_layout->stride);
 
       m_built = true;
    }
 
+   StreamBuffer &stream() {
+      if (!m_stream) {
+         m_stream.reset(new StreamBuffer(m_vertexSize * m_vertexCount));
+      }
+      return *m_stream;
+   }
+
+   GLenum getGLIndexType() const {
+      return m_indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+   }
+
+   void *firstIndexOffset() const {
+      return (void*)(m_slice.firstIndex * m_indexSize);
+   }
+
 public:
-   Model(void *data, size_t size, size_t vCount, VertexAttribute *attrs, int attrCount, ModelManager::DataStreamType dataType)
+   Model(void *data, size_t size, size_t vCount, VertexAttribute const *attrs, int attrCount, ModelManager::DataStreamType dataType,
+      uint32_t const *indices, size_t indexCount)
       : m_vertexSize(size),
       m_vertexCount(vCount),
       m_attrs(attrs, attrs + attrCount),
+      m_layout(vertexFormats::Instance().get(attrs, attrCount, size)),
       m_data(new byte[size * vCount]),
       m_built(false),
-      m_dirtyData(false),
-      m_dataType(dataType){
+      m_dataType(dataType),
+      m_indexSize(0),
+      m_indexCount(indexCount),
+      m_vao(0),
+      m_iboHandle(0),
+      m_arena(nullptr),
+      m_slice({ 0, 0 }){
 
       //NEVERFORGET the night brandon spent 2 hours debugging empty data
       memcpy(m_data.get(), data, size * vCount);
+
+      m_bounds = calculateBounds(m_data.get(), size, vCount, attrs, attrCount);
+      if (dataType != ModelManager::Static) {
+         m_bounds.valid = false;
+      }
+
+      if (indexCount) {
+         if (vCount <= 0x10000) {
+            m_indexSize = sizeof(uint16_t);
+            m_indexData.reset(new byte[m_indexSize * indexCount]);
+
+            auto out = (uint16_t*)m_indexData.get();
+            for (size_t i = 0; i < indexCount; ++i) {
+               out[i] = (uint16_t)indices[i];
+            }
+         }
+         else {
+            m_indexSize = sizeof(uint32_t);
+            m_indexData.reset(new byte[m_indexSize * indexCount]);
+            memcpy(m_indexData.get(), indices, m_indexSize * indexCount);
+         }
+      }
+
+      if (dataType == ModelManager::Static) {
+         m_arena = staticArenas::Instance().get(m_layout, m_indexSize);
+      }
+
+      //models get created from loader threads too, two of them must never share an id
+      static std::atomic<int> nextID(0);
+      m_id = nextID++;
+   }
+
+   int getID() { return m_id; }
+   int getBatchKey() { return m_arena ? m_arena->getID() : 0; }
+   ModelManager::Bounds const &getBounds() { return m_bounds; }
+
+   ModelManager::Description describe() {
+      ModelManager::Description out;
+      //streamed updates only exist in gpu memory, captures get the data the model was created with
+      out.data = m_data.get();
+      out.vertexSize = m_vertexSize;
+      out.vertexCount = m_vertexCount;
+      out.attrs = m_attrs.data();
+      out.attrCount = (int)m_attrs.size();
+      out.dataType = m_dataType;
+      out.indices = m_indexData.get();
+      out.indexSize = m_indexSize;
+      out.indexCount = m_indexCount;
+      return out;
    }
 
    ~Model() {
+      //updates can create the stream before the first build
+      if (!m_built && !m_stream) {
+         return;
+      }
+
+      ModelGarbage::Entry entry;
+      entry.arena = m_built ? m_arena : nullptr;
+      entry.slice = m_slice;
+      entry.vCount = m_vertexCount;
+      entry.iCount = m_indexCount;
+      entry.vao = m_arena ? 0 : m_vao;
+      entry.ibo = m_iboHandle;
+      entry.stream = std::move(m_stream);
+      entry.frame = 0;
+      modelGarbage::Instance().push(std::move(entry));
    }
 
    void updateData(void *data, size_t size, size_t vCount) {
@@ -85,75 +617,98 @@ public:
          return; //picnic
       }
 
-      if (!m_dataNewData) {
-         m_dataNewData.reset(new byte[size * vCount]);
+      auto &s = stream();
+      memcpy(s.beginWrite(), data, size * vCount);
+
+      //repoint the vao without binding it, whatever model is bound stays bound
+      if (m_built) {
+         gl::VertexArrayVertexBuffer(m_vao, 0, s.getHandle(), s.getOffset(), m_layout->stride);
       }
-      memcpy(m_dataNewData.get(), data, size * vCount);
-      m_dirtyData = true;
    }
 
    void bind() {
       if (!m_built) {
          build();
       }
-
-      glBindBuffer(GL_ARRAY_BUFFER, m_vboHandle);
-
-      if (m_dataNewData && m_dirtyData) {
-         glBufferData(GL_ARRAY_BUFFER, m_vertexSize * m_vertexCount, m_dataNewData.get(), getGLDataType(m_dataType));
-         m_dirtyData = false;
+      else {
+         gl::BindVertexArray(m_vao);
       }
+   }
 
-      //clear current attribs
-      for (unsigned int i = 0; i < (unsigned int)VertexAttribute::COUNT; ++i) {
-         glDisableVertexAttribArray(i);
+   void render(ModelManager::RenderType type) {
+      if (m_indexCount) {
+         gl::DrawElementsBaseVertex(getGLRenderType(type), (GLsizei)m_indexCount, getGLIndexType(), firstIndexOffset(),
+            (GLint)m_slice.baseVertex);
+      }
+      else {
+         gl::DrawArrays(getGLRenderType(type), (GLint)m_slice.baseVertex, (GLsizei)m_vertexCount);
       }
+   }
 
-      int totalOffset = 0;
-      for (auto && attr : m_attrs) {
-         glEnableVertexAttribArray((unsigned int)attr);
-         int count = 0;
-         int offset = totalOffset;
+   void renderInstanced(ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+      auto &ib = instanceBuffer::Instance();
 
-         totalOffset += vertexAttributeByteSize(attr);
+      ib.bind(instances, count);
+      if (m_indexCount) {
+         gl::DrawElementsInstancedBaseVertex(getGLRenderType(type), (GLsizei)m_indexCount, getGLIndexType(), firstIndexOffset(),
+            (GLsizei)count, (GLint)m_slice.baseVertex);
+      }
+      else {
+         gl::DrawArraysInstanced(getGLRenderType(type), (GLint)m_slice.baseVertex, (GLsizei)m_vertexCount, (GLsizei)count);
+      }
+      ib.unbind();
+   }
 
-         switch (attr) {
-         case VertexAttribute::Tex2:
-         case VertexAttribute::Pos2:
-            count = 2;
-            break;
-         case VertexAttribute::Pos3:
-         case VertexAttribute::Norm3:
-            count = 3;
-            break;
-         case VertexAttribute::Col4:
-            count = 4;
-            break;
+   //models is every model in the batch, this one included, they all share this model's arena
+   void renderBatch(Model *const *models, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+      for (size_t i = 0; i < count; ++i) {
+         if (!models[i]->m_built) {
+            models[i]->build();
+         }
+      }
+      gl::BindVertexArray(m_vao);
+
+      auto &ib = instanceBuffer::Instance();
+      auto &ring = indirectRing();
+      ib.bind(instances, count);
+
+      //one instance per draw, its base instance picks out the matching transform and color
+      StreamRing::Allocation commands;
+      if (m_indexCount) {
+         commands = ring.alloc(sizeof(DrawElementsIndirectCommand) * count, sizeof(GLuint));
+         auto out = (DrawElementsIndirectCommand*)commands.data;
+         for (size_t i = 0; i < count; ++i) {
+            auto m = models[i];
+            out[i] = { (GLuint)m->m_indexCount, 1, (GLuint)m->m_slice.firstIndex, (GLint)m->m_slice.baseVertex, (GLuint)i };
+         }
+      }
+      else {
+         commands = ring.alloc(sizeof(DrawArraysIndirectCommand) * count, sizeof(GLuint));
+         auto out = (DrawArraysIndirectCommand*)commands.data;
+         for (size_t i = 0; i < count; ++i) {
+            auto m = models[i];
+            out[i] = { (GLuint)m->m_vertexCount, 1, (GLuint)m->m_slice.baseVertex, (GLuint)i };
          }
-
-         glVertexAttribPointer((unsigned int)attr,
-            count, GL_FLOAT, GL_FALSE, m_vertexSize, (void*)offset);
       }
-   }
 
-   void render(ModelManager::RenderType type) {
-      static GLuint map[3];
-      static bool mapInit = false;
-      if (!mapInit) {
-         mapInit = true;
-         map[ModelManager::Triangles] = GL_TRIANGLES;
-         map[ModelManager::Lines] = GL_LINES;
-         map[ModelManager::Points] = GL_POINTS;
+      gl::BindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.handle);
+      if (m_indexCount) {
+         gl::MultiDrawElementsIndirect(getGLRenderType(type), getGLIndexType(), (void*)commands.offset, (GLsizei)count, 0);
       }
+      else {
+         gl::MultiDrawArraysIndirect(getGLRenderType(type), (void*)commands.offset, (GLsizei)count, 0);
+      }
+      gl::BindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
-      glDrawArrays(map[type], 0, m_vertexCount);
+      ib.unbind();
    }
 };
 
-Model *ModelManager::_create(void *data, size_t size, size_t vCount, VertexAttribute *attrs, int attrCount, DataStreamType dataType) {
-   return new Model(data, size, vCount, attrs, attrCount, dataType);
+Model *ModelManager::_create(void *data, size_t size, size_t vCount, VertexAttribute const *attrs, int attrCount, DataStreamType dataType,
+   uint32_t const *indices, size_t indexCount) {
+   return new Model(data, size, vCount, attrs, attrCount, dataType, indices, indexCount);
 }
-void ModelManager::_updateData(Model *self, void *data, size_t size, size_t vCount) {
+void ModelManager::updateData(Model *self, void *data, size_t size, size_t vCount) {
    self->updateData(data, size, vCount);
 }
 
@@ -161,5 +716,19 @@ void ModelManager::destroy(Model *self) {
    delete self;
 }
 
+void ModelManager::beginFrame() {
+   modelGarbage::Instance().collect();
+}
+
+int ModelManager::getID(Model *self) { return self->getID(); }
+int ModelManager::getBatchKey(Model *self) { return self->getBatchKey(); }
+ModelManager::Description ModelManager::describe(Model *self) { return self->describe(); }
+ModelManager::Bounds ModelManager::getBounds(Model *self) { return self->getBounds(); }
 void ModelManager::bind(Model *self) { self->bind(); }
 void ModelManager::draw(Model *self, RenderType type) { self->render(type); }
+void ModelManager::drawInstanced(Model *self, ModelInstance const *instances, size_t count, RenderType type) { self->renderInstanced(instances, count, type); }
+void ModelManager::drawBatch(Model *const *models, ModelInstance const *instances, size_t count, RenderType type) {
+   if (count) {
+      models[0]->renderBatch(models, instances, count, type);
+   }
+}
@@ -3,6 +3,8 @@
 #include "Geom.hpp"
 #include "Color.hpp"
 
+#include <stddef.h>
+#include <stdint.h>
 #include <vector>
 
 
@@ -29,6 +31,13 @@ struct ModelVertices {
    ModelVertices &calculateNormals();
    ModelVertices &expandIndices();
    Model *createModel(int modelOptions = 0);
+   //expanded vertices drawn through indices
+   Model *createModel(std::vector<uint32_t> const &indices, int modelOptions = 0) const;
+   //merges corners with identical attributes into shared vertices and draws them through an index buffer
+   //works on indexed or already expanded vertices
+   Model *createIndexedModel(int modelOptions = 0);
+   //the merge createIndexedModel does, returns expanded vertices with one entry per unique corner
+   ModelVertices weld(std::vector<uint32_t> &indices) const;
 };
 
 enum class VertexAttribute : unsigned int {
@@ -37,79 +46,164 @@ enum class VertexAttribute : unsigned int {
    Tex2,
    Col4,
    Norm3,
+
+   //per instance, filled from ModelInstance
+   InstModel = 5, //mat4, takes up 4 locations
+   InstCol4 = 9,
    COUNT
 };
 
-int vertexAttributeByteSize(VertexAttribute attr);
+constexpr int vertexAttributeByteSize(VertexAttribute attr) {
+   return attr == VertexAttribute::Pos2 || attr == VertexAttribute::Tex2 ? (int)sizeof(Float2) :
+      attr == VertexAttribute::Pos3 || attr == VertexAttribute::Norm3 ? (int)sizeof(Float3) :
+      attr == VertexAttribute::Col4 || attr == VertexAttribute::InstCol4 ? (int)sizeof(ColorRGBAf) :
+      attr == VertexAttribute::InstModel ? (int)sizeof(Matrix) : 0;
+}
+
+//per instance data for instanced draws, one of these per copy of the model
+struct ModelInstance {
+   Matrix transform;
+   ColorRGBAf color;
+};
 
 #pragma region Vertex objects
 
-#define FVF_ATTRS(...) \
-   static std::vector<VertexAttribute> &attrs() { \
-      static std::vector<VertexAttribute> out; \
-      if (out.empty()) { \
-         out = {__VA_ARGS__}; \
-      } \
-      return out; \
+//the member an attribute lives in, every FVF names them the same way
+template<VertexAttribute Attr> struct FVFMember;
+
+template<> struct FVFMember<VertexAttribute::Pos2> {
+   typedef Float2 Type;
+   template<typename V> static constexpr size_t offset() { return offsetof(V, pos2); }
+   template<typename V> static Type &get(V &vertex) { return vertex.pos2; }
+};
+
+template<> struct FVFMember<VertexAttribute::Pos3> {
+   typedef Float3 Type;
+   template<typename V> static constexpr size_t offset() { return offsetof(V, pos3); }
+   template<typename V> static Type &get(V &vertex) { return vertex.pos3; }
+};
+
+template<> struct FVFMember<VertexAttribute::Tex2> {
+   typedef Float2 Type;
+   template<typename V> static constexpr size_t offset() { return offsetof(V, tex2); }
+   template<typename V> static Type &get(V &vertex) { return vertex.tex2; }
+};
+
+template<> struct FVFMember<VertexAttribute::Col4> {
+   typedef ColorRGBAf Type;
+   template<typename V> static constexpr size_t offset() { return offsetof(V, col4); }
+   template<typename V> static Type &get(V &vertex) { return vertex.col4; }
+};
+
+template<> struct FVFMember<VertexAttribute::Norm3> {
+   typedef Float3 Type;
+   template<typename V> static constexpr size_t offset() { return offsetof(V, norm3); }
+   template<typename V> static Type &get(V &vertex) { return vertex.norm3; }
+};
+
+//walks an attribute list one entry at a time, Offset is where the next attribute starts when everything
+//before it is packed
+template<typename Self, size_t Offset, VertexAttribute... Attrs>
+struct FVFPacking {
+   static constexpr size_t stride() { return Offset; }
+   static constexpr bool has(VertexAttribute) { return false; }
+   static constexpr bool matches() { return sizeof(Self) == Offset; }
+};
+
+template<typename Self, size_t Offset, VertexAttribute First, VertexAttribute... Rest>
+struct FVFPacking<Self, Offset, First, Rest...> {
+   typedef FVFPacking<Self, Offset + vertexAttributeByteSize(First), Rest...> Next;
+
+   static constexpr size_t stride() { return Next::stride(); }
+   static constexpr bool has(VertexAttribute attr) { return attr == First || Next::has(attr); }
+   static constexpr bool matches() {
+      return FVFMember<First>::template offset<Self>() == Offset &&
+         sizeof(typename FVFMember<First>::Type) == (size_t)vertexAttributeByteSize(First) &&
+         Next::matches();
    }
+};
+
+//attribute list of a vertex struct, known at compile time
+//the gl side assumes the members follow the list with nothing in between, matches() checks that against
+//the real struct and ModelManager::create static_asserts on it, so it only gets called once Self is complete
+template<typename Self, VertexAttribute... Attrs>
+struct VertexLayout {
+   static_assert(sizeof...(Attrs) > 0, "a vertex needs at least one attribute");
+
+   typedef FVFPacking<Self, 0, Attrs...> Packing;
+
+   static constexpr int count = (int)sizeof...(Attrs);
+
+   static VertexAttribute const *attrs() {
+      static VertexAttribute const out[] = { Attrs... };
+      return out;
+   }
+
+   static constexpr bool has(VertexAttribute attr) { return Packing::has(attr); }
+   static constexpr size_t stride() { return Packing::stride(); }
+   static constexpr bool matches() { return Packing::matches(); }
+};
+
+#define FVF_LAYOUT(Self, ...) \
+   typedef VertexLayout<Self, __VA_ARGS__> Layout;
 
 class FVF_Pos2_Tex2_Col4 {
 public:
-   FVF_ATTRS( VertexAttribute::Pos2, VertexAttribute::Tex2, VertexAttribute::Col4 )
+   FVF_LAYOUT(FVF_Pos2_Tex2_Col4, VertexAttribute::Pos2, VertexAttribute::Tex2, VertexAttribute::Col4)
    Float2 pos2, tex2; ColorRGBAf col4;
 };
 
 class FVF_Pos2_Col4 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos2, VertexAttribute::Col4)
+   FVF_LAYOUT(FVF_Pos2_Col4, VertexAttribute::Pos2, VertexAttribute::Col4)
    Float2 pos2; ColorRGBAf col4;
 };
 
 class FVF_Pos3 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos3)
+   FVF_LAYOUT(FVF_Pos3, VertexAttribute::Pos3)
    Float3 pos3;
 };
 
 class FVF_Pos3_Col4 {
 public:
-   FVF_ATTRS( VertexAttribute::Pos3, VertexAttribute::Col4 )
+   FVF_LAYOUT(FVF_Pos3_Col4, VertexAttribute::Pos3, VertexAttribute::Col4)
    Float3 pos3; ColorRGBAf col4;
 };
 
 class FVF_Pos3_Tex2_Col4 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos3, VertexAttribute::Tex2, VertexAttribute::Col4)
+   FVF_LAYOUT(FVF_Pos3_Tex2_Col4, VertexAttribute::Pos3, VertexAttribute::Tex2, VertexAttribute::Col4)
    Float3 pos3; Float2 tex2; ColorRGBAf col4;
 };
 
 class FVF_Pos3_Tex2 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos3, VertexAttribute::Tex2)
+   FVF_LAYOUT(FVF_Pos3_Tex2, VertexAttribute::Pos3, VertexAttribute::Tex2)
    Float3 pos3; Float2 tex2;
 };
 
 class FVF_Pos3_Norm3_Tex2_Col4 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos3, VertexAttribute::Norm3, VertexAttribute::Tex2, VertexAttribute::Col4)
+   FVF_LAYOUT(FVF_Pos3_Norm3_Tex2_Col4, VertexAttribute::Pos3, VertexAttribute::Norm3, VertexAttribute::Tex2, VertexAttribute::Col4)
    Float3 pos3, norm3; Float2 tex2; ColorRGBAf col4;
 };
 
 class FVF_Pos3_Norm3_Tex2 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos3, VertexAttribute::Norm3, VertexAttribute::Tex2)
+   FVF_LAYOUT(FVF_Pos3_Norm3_Tex2, VertexAttribute::Pos3, VertexAttribute::Norm3, VertexAttribute::Tex2)
    Float3 pos3, norm3; Float2 tex2;
 };
 
 class FVF_Pos3_Norm3_Col4 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos3, VertexAttribute::Norm3, VertexAttribute::Col4)
+   FVF_LAYOUT(FVF_Pos3_Norm3_Col4, VertexAttribute::Pos3, VertexAttribute::Norm3, VertexAttribute::Col4)
    Float3 pos3, norm3; ColorRGBAf col4;
 };
 
 class FVF_Pos3_Norm3 {
 public:
-   FVF_ATTRS(VertexAttribute::Pos3, VertexAttribute::Norm3)
+   FVF_LAYOUT(FVF_Pos3_Norm3, VertexAttribute::Pos3, VertexAttribute::Norm3)
    Float3 pos3, norm3;
 };
 
@@ -118,6 +212,7 @@ public:
 
 
 class ModelManager {
+   friend class FrameReplay;
 public:
    enum DataStreamType {
       Stream,
@@ -131,23 +226,76 @@ public:
       Points
    };
 
+   //everything needed to create an identical model
+   struct Description {
+      void const *data;
+      size_t vertexSize, vertexCount;
+      VertexAttribute const *attrs;
+      int attrCount;
+      DataStreamType dataType;
+
+      //null when the model isn't indexed, indexSize is 2 or 4
+      void const *indices;
+      size_t indexSize, indexCount;
+   };
+
+   //object space bounds of the vertices the model was created with, worked out once at creation
+   //valid is false for models without positions and for Stream and Dynamic models, their vertices can end up anywhere
+   struct Bounds {
+      bool valid;
+      AABB box;
+      Sphere sphere;
+   };
+
 private:
-   static Model *_create(void *data, size_t size, size_t vCount, VertexAttribute *attrs, int attrCount, DataStreamType dataType);
-   static void _updateData(Model *self, void *data, size_t size, size_t vCount);
+   static Model *_create(void *data, size_t size, size_t vCount, VertexAttribute const *attrs, int attrCount, DataStreamType dataType,
+      uint32_t const *indices = nullptr, size_t indexCount = 0);
 
 public:
    template<typename FVF>
    static Model *create(std::vector<FVF> &data, DataStreamType dataType = Static) {
-      return _create((void*)data.data(), sizeof(FVF), data.size(), FVF::attrs().data(), FVF::attrs().size(), dataType);
+      static_assert(FVF::Layout::matches(), "vertex members don't follow the attribute list");
+      return _create((void*)data.data(), sizeof(FVF), data.size(), FVF::Layout::attrs(), FVF::Layout::count, dataType);
+   }
+
+   //drawn with glDrawElements, indices are stored as 16 bit when every vertex fits and never change
+   //updateData() still replaces the vertices, the count has to stay the same
+   template<typename FVF>
+   static Model *create(std::vector<FVF> &data, std::vector<uint32_t> const &indices, DataStreamType dataType = Static) {
+      static_assert(FVF::Layout::matches(), "vertex members don't follow the attribute list");
+      return _create((void*)data.data(), sizeof(FVF), data.size(), FVF::Layout::attrs(), FVF::Layout::count, dataType,
+         indices.data(), indices.size());
    }
 
    template<typename FVF>
    static void updateData(Model *self, std::vector<FVF> &data) {
-      return _updateData(self, data.data(), sizeof(FVF), data.size());
+      static_assert(FVF::Layout::matches(), "vertex members don't follow the attribute list");
+      return updateData(self, data.data(), sizeof(FVF), data.size());
    }
+   //gl thread only, Stream and Dynamic models write into a persistently mapped ring
+   //that holds the last few frames of data, Static models ignore updates
+   static void updateData(Model *self, void *data, size_t size, size_t vCount);
 
+   //any thread, the gl objects are deleted on the gl thread once frames still in flight are done with them
    static void destroy(Model *self);
+   //gl thread, once a frame before anything draws
+   static void beginFrame();
+   //small sequential id, stable for the life of the model
+   static int getID(Model *self);
+   //models sharing a non-zero key can go into one drawBatch, 0 means the model never batches
+   //Static models with the same vertex layout and index size share one buffer and get the same key
+   static int getBatchKey(Model *self);
+   //data is the vertex data the model was created with
+   static Description describe(Model *self);
+   //never changes, safe from any thread
+   static Bounds getBounds(Model *self);
    static void bind(Model *self);
    static void draw(Model *self, RenderType type = Triangles);
+   //call after bind(), instances are uploaded to a shared stream buffer
+   static void drawInstanced(Model *self, ModelInstance const *instances, size_t count, RenderType type = Triangles);
+   //one multi draw indirect for every model, they all have to share a batch key
+   //instances[i] is the transform and color of models[i], use a shader built with Instanced
+   //call after bind() on any of the models
+   static void drawBatch(Model *const *models, ModelInstance const *instances, size_t count, RenderType type = Triangles);
 };
 
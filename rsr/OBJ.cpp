@@ -1,6 +1,9 @@
 #include "Model.hpp"
 
+#include <algorithm>
 #include <string>
+#include <string.h>
+#include <unordered_map>
 #include <vector>
 
 static bool isWhitespace(char c) {
@@ -332,61 +335,172 @@ ModelVertices &ModelVertices::expandIndices() {
    return *this;
 }
 
-template<typename FVF>
-Model *createModelEX(ModelVertices const &vertices) {
-   std::vector<FVF> outVertices;
-   size_t pCount = vertices.positions.size();
-
-   std::vector<VertexAttribute> &attrs = FVF::attrs();
-   auto colorIter = std::find(attrs.begin(), attrs.end(), VertexAttribute::Col4);
-   auto textureIter = std::find(attrs.begin(), attrs.end(), VertexAttribute::Tex2);
-   auto normalIter = std::find(attrs.begin(), attrs.end(), VertexAttribute::Norm3);
-
-   bool hasColor = colorIter != attrs.end();
-   bool hasTexture = textureIter != attrs.end();
-   bool hasNormal = normalIter != attrs.end();
-
-   int colorPos = 0, texturePos = 0, normalPos = 0;
-
-   if (hasColor) { colorPos = colorIter - attrs.begin(); }
-   if (hasTexture) { texturePos = textureIter - attrs.begin(); }
-   if (hasNormal) { normalPos = normalIter - attrs.begin(); }
-
-   std::vector<int> attrOffsets(attrs.size());
-   int totalSize = 0;
-   for (int i = 0; i < attrs.size(); ++i) {
-      attrOffsets[i] = totalSize;
-      totalSize += vertexAttributeByteSize(attrs[i]);
-      
-   }
+//where each attribute of an expanded vertex comes from
+//colors are optional, without any every vertex reads the same white through a step of 0
+struct VertexSources {
+   Float3 const *positions;
+   Float2 const *textures;
+   Float3 const *normals;
+   ColorRGBAf const *colors;
+   size_t colorStep;
+};
 
-   for (size_t i = 0; i < pCount; ++i) {
-      FVF vertex;
-      vertex.pos3 = vertices.positions[i];
+template<VertexAttribute Attr> struct VertexSource;
 
-      //cant specify the names of the attrs directly
-      //have to do some c-style byte-casting with offsets to get the data into the right spot
-      if (hasColor) { *(ColorRGBAf*)(((unsigned char *)&vertex) + attrOffsets[colorPos]) = vertices.colors.empty() ? CommonColors::White : vertices.colors[i]; }
-      if (hasTexture) { *(Float2*)(((unsigned char *)&vertex) + attrOffsets[texturePos]) = vertices.textures[i]; }
-      if (hasNormal) { *(Float3*)(((unsigned char *)&vertex) + attrOffsets[normalPos]) = vertices.normals[i]; }
+template<> struct VertexSource<VertexAttribute::Pos3> {
+   static Float3 get(VertexSources const &s, size_t i) { return s.positions[i]; }
+};
+
+template<> struct VertexSource<VertexAttribute::Tex2> {
+   static Float2 get(VertexSources const &s, size_t i) { return s.textures[i]; }
+};
 
-      outVertices.push_back(vertex);
+template<> struct VertexSource<VertexAttribute::Norm3> {
+   static Float3 get(VertexSources const &s, size_t i) { return s.normals[i]; }
+};
+
+template<> struct VertexSource<VertexAttribute::Col4> {
+   static ColorRGBAf get(VertexSources const &s, size_t i) { return s.colors[i * s.colorStep]; }
+};
+
+//one store per attribute of the layout, expanded at compile time so nothing gets looked up per vertex
+template<typename FVF, VertexAttribute... Attrs>
+static void interleave(std::vector<FVF> &out, VertexSources const &sources, VertexLayout<FVF, Attrs...>) {
+   for (size_t i = 0; i < out.size(); ++i) {
+      int expand[] = { (FVFMember<Attrs>::get(out[i]) = VertexSource<Attrs>::get(sources, i), 0)... };
+      (void)expand;
    }
+}
+
+template<typename FVF>
+Model *createModelEX(ModelVertices const &vertices, std::vector<uint32_t> const *indices) {
+   typedef typename FVF::Layout Layout;
+   static_assert(Layout::has(VertexAttribute::Pos3), "models from ModelVertices need 3d positions");
+
+   static ColorRGBAf const white = CommonColors::White;
+   bool hasColors = !vertices.colors.empty();
 
+   VertexSources sources = {
+      vertices.positions.data(),
+      vertices.textures.data(),
+      vertices.normals.data(),
+      hasColors ? vertices.colors.data() : &white,
+      hasColors ? (size_t)1 : (size_t)0 };
+
+   std::vector<FVF> outVertices(vertices.positions.size());
+   interleave(outVertices, sources, Layout());
+
+   if (indices) {
+      return ModelManager::create(outVertices, *indices);
+   }
    return ModelManager::create(outVertices);
 }
 
-Model *ModelVertices::createModel(int modelOptions) {
+//vertices have to be expanded, indices are optional
+static Model *createModelFromOptions(ModelVertices const &v, std::vector<uint32_t> const *indices, int modelOptions) {
    bool c = modelOptions&ModelOpts::IncludeColor;
    bool t = modelOptions&ModelOpts::IncludeTexture;
    bool n = modelOptions&ModelOpts::IncludeNormals;
 
-   if (c && t && n) { return createModelEX<FVF_Pos3_Norm3_Tex2_Col4>(*this); }
-   else if (c && n) { return createModelEX<FVF_Pos3_Norm3_Col4>(*this); }
-   else if(c && t ) { return createModelEX<FVF_Pos3_Tex2_Col4>(*this); }
-   else if(t && n) { return createModelEX<FVF_Pos3_Norm3_Tex2>(*this); }
-   else if(c) { return createModelEX<FVF_Pos3_Col4>(*this); }
-   else if(t) { return createModelEX<FVF_Pos3_Tex2>(*this); }
-   else if(n) { return createModelEX<FVF_Pos3_Norm3>(*this); }
-   else { return createModelEX<FVF_Pos3>(*this); }
+   if (c && t && n) { return createModelEX<FVF_Pos3_Norm3_Tex2_Col4>(v, indices); }
+   else if (c && n) { return createModelEX<FVF_Pos3_Norm3_Col4>(v, indices); }
+   else if(c && t ) { return createModelEX<FVF_Pos3_Tex2_Col4>(v, indices); }
+   else if(t && n) { return createModelEX<FVF_Pos3_Norm3_Tex2>(v, indices); }
+   else if(c) { return createModelEX<FVF_Pos3_Col4>(v, indices); }
+   else if(t) { return createModelEX<FVF_Pos3_Tex2>(v, indices); }
+   else if(n) { return createModelEX<FVF_Pos3_Norm3>(v, indices); }
+   else { return createModelEX<FVF_Pos3>(v, indices); }
+}
+
+Model *ModelVertices::createModel(int modelOptions) {
+   return createModelFromOptions(*this, nullptr, modelOptions);
+}
+
+//everything a corner can carry, compared bytewise so only exact duplicates get merged
+struct CornerKey {
+   Float3 position;
+   Float2 texture;
+   Float3 normal;
+   ColorRGBAf color;
+
+   bool operator==(CornerKey const &other) const {
+      return !memcmp(this, &other, sizeof(CornerKey));
+   }
+};
+
+struct CornerKeyHash {
+   size_t operator()(CornerKey const &key) const {
+      //fnv-1a
+      size_t out = 2166136261u;
+      auto bytes = (unsigned char const *)&key;
+      for (size_t i = 0; i < sizeof(CornerKey); ++i) {
+         out = (out ^ bytes[i]) * 16777619u;
+      }
+      return out;
+   }
+};
+
+Model *ModelVertices::createModel(std::vector<uint32_t> const &indices, int modelOptions) const {
+   return createModelFromOptions(*this, &indices, modelOptions);
+}
+
+ModelVertices ModelVertices::weld(std::vector<uint32_t> &indices) const {
+   //expanded vertices are their own corners
+   bool indexed = !positionIndices.empty();
+   size_t cornerCount = indexed ? positionIndices.size() : positions.size();
+
+   bool hasTextures = indexed ? !textureIndices.empty() : !textures.empty();
+   bool hasNormals = indexed ? !normalIndices.empty() : !normals.empty();
+   bool hasColors = !colors.empty();
+
+   ModelVertices unique;
+   indices.clear();
+   std::unordered_map<CornerKey, uint32_t, CornerKeyHash> lookup;
+
+   indices.reserve(cornerCount);
+   lookup.reserve(cornerCount);
+
+   for (size_t i = 0; i < cornerCount; ++i) {
+      int pIndex = indexed ? positionIndices[i] : (int)i;
+
+      CornerKey key;
+      memset(&key, 0, sizeof(key));
+
+      key.position = positions[pIndex];
+      if (hasColors) {
+         key.color = colors[pIndex];
+      }
+      if (hasTextures) {
+         key.texture = textures[indexed ? textureIndices[i] : i];
+      }
+      if (hasNormals) {
+         key.normal = normals[indexed ? normalIndices[i] : i];
+      }
+
+      auto found = lookup.find(key);
+      if (found == lookup.end()) {
+         found = lookup.insert(std::make_pair(key, (uint32_t)unique.positions.size())).first;
+
+         unique.positions.push_back(key.position);
+         if (hasColors) {
+            unique.colors.push_back(key.color);
+         }
+         if (hasTextures) {
+            unique.textures.push_back(key.texture);
+         }
+         if (hasNormals) {
+            unique.normals.push_back(key.normal);
+         }
+      }
+
+      indices.push_back(found->second);
+   }
+
+   return unique;
+}
+
+Model *ModelVertices::createIndexedModel(int modelOptions) {
+   std::vector<uint32_t> indices;
+   auto unique = weld(indices);
+   return createModelFromOptions(unique, &indices, modelOptions);
 }
\ No newline at end of file
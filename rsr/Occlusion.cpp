@@ -0,0 +1,517 @@
+#include "Occlusion.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <math.h>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define RSR_SSE
+#include <xmmintrin.h>
+#endif
+
+static const int TileWidth = 32;
+static const int TileHeight = 16;
+
+//anything closer is clipped away, keeps 1/w finite
+static const float NearW = 1e-3f;
+//triangles are clipped to this many screen sizes so edge functions keep their precision
+static const float GuardBand = 4.0f;
+//a box has to be this much farther than the occluders, float error mustn't hide what sits right on them
+static const float DepthBias = 1e-3f;
+
+//fewer triangles than this aren't worth waking the workers for
+static const size_t ParallelThreshold = 256;
+
+OccluderMesh OccluderMesh::fromVertices(ModelVertices const &vertices) {
+   OccluderMesh out;
+   out.positions = vertices.positions;
+
+   if (vertices.positionIndices.empty()) {
+      for (uint32_t i = 0; i < (uint32_t)vertices.positions.size(); ++i) {
+         out.indices.push_back(i);
+      }
+   }
+   else {
+      out.indices.assign(vertices.positionIndices.begin(), vertices.positionIndices.end());
+   }
+
+   return out;
+}
+
+class OcclusionCuller::Impl {
+   struct ClipVertex {
+      float x, y, z, w;
+   };
+
+   //edge functions are >= 0 inside, depth is a plane in screen space since 1/w interpolates linearly there
+   struct Triangle {
+      float a[3], b[3], c[3];
+      float za, zb, zc;
+      int x0, y0, x1, y1; //pixel centers covered by the bounds, inclusive
+   };
+
+   int m_width, m_height;
+   int m_tilesX, m_tilesY;
+
+   //level 0 is the buffer itself, each level after is the min of 2x2 of the one before
+   std::vector<std::vector<float>> m_levels;
+   std::vector<int> m_levelWidths, m_levelHeights;
+
+   Matrix m_viewProj = Matrix::identity();
+   std::vector<ClipVertex> m_clip;
+   std::vector<Triangle> m_triangles;
+   std::vector<std::vector<uint32_t>> m_bins;
+
+   std::vector<std::thread> m_workers;
+   std::mutex m_workMutex;
+   std::condition_variable m_workCond, m_doneCond;
+   uint64_t m_generation = 0;
+   size_t m_busyWorkers = 0;
+   bool m_stopping = false;
+   std::atomic<int> m_nextTile;
+
+   static ClipVertex lerp(ClipVertex const &a, ClipVertex const &b, float t) {
+      return {
+         a.x + (b.x - a.x) * t,
+         a.y + (b.y - a.y) * t,
+         a.z + (b.z - a.z) * t,
+         a.w + (b.w - a.w) * t };
+   }
+
+   //signed distance to the near plane and the four guard band planes, inside is >= 0
+   static float planeDistance(ClipVertex const &v, int plane) {
+      switch (plane) {
+      case 0: return v.w - NearW;
+      case 1: return v.x + GuardBand * v.w;
+      case 2: return GuardBand * v.w - v.x;
+      case 3: return v.y + GuardBand * v.w;
+      default: return GuardBand * v.w - v.y;
+      }
+   }
+
+   static const int PlaneCount = 5;
+
+   void transformVertices(OccluderMesh const &mesh, Matrix const &m) {
+      size_t count = mesh.positions.size();
+      m_clip.resize(count);
+
+#ifdef RSR_SSE
+      __m128 c0 = _mm_loadu_ps(&m[0]);
+      __m128 c1 = _mm_loadu_ps(&m[4]);
+      __m128 c2 = _mm_loadu_ps(&m[8]);
+      __m128 c3 = _mm_loadu_ps(&m[12]);
+
+      for (size_t i = 0; i < count; ++i) {
+         auto &p = mesh.positions[i];
+         __m128 clip = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y))),
+            _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p.z)), c3));
+         _mm_storeu_ps(&m_clip[i].x, clip);
+      }
+#else
+      for (size_t i = 0; i < count; ++i) {
+         auto &p = mesh.positions[i];
+         auto &c = m_clip[i];
+         c.x = m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12];
+         c.y = m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13];
+         c.z = m[2] * p.x + m[6] * p.y + m[10] * p.z + m[14];
+         c.w = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+      }
+#endif
+   }
+
+   //sutherland-hodgman against the planes the triangle actually crosses, then a fan
+   void clipTriangle(ClipVertex const &v0, ClipVertex const &v1, ClipVertex const &v2) {
+      int outside = 0;
+      for (int p = 0; p < PlaneCount; ++p) {
+         float d0 = planeDistance(v0, p), d1 = planeDistance(v1, p), d2 = planeDistance(v2, p);
+         if (d0 < 0.0f && d1 < 0.0f && d2 < 0.0f) {
+            return;
+         }
+         if (d0 < 0.0f || d1 < 0.0f || d2 < 0.0f) {
+            outside |= 1 << p;
+         }
+      }
+
+      if (!outside) {
+         setupTriangle(v0, v1, v2);
+         return;
+      }
+
+      ClipVertex buffers[2][3 + PlaneCount];
+      int counts[2] = { 3, 0 };
+      buffers[0][0] = v0;
+      buffers[0][1] = v1;
+      buffers[0][2] = v2;
+      int src = 0;
+
+      for (int p = 0; p < PlaneCount; ++p) {
+         if (!(outside & (1 << p))) {
+            continue;
+         }
+
+         auto *in = buffers[src];
+         auto *out = buffers[src ^ 1];
+         int inCount = counts[src], outCount = 0;
+
+         for (int i = 0; i < inCount; ++i) {
+            auto &a = in[i];
+            auto &b = in[(i + 1) % inCount];
+            float da = planeDistance(a, p), db = planeDistance(b, p);
+
+            if (da >= 0.0f) {
+               out[outCount++] = a;
+            }
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+               out[outCount++] = lerp(a, b, da / (da - db));
+            }
+         }
+
+         counts[src ^ 1] = outCount;
+         src ^= 1;
+         if (outCount < 3) {
+            return;
+         }
+      }
+
+      auto *poly = buffers[src];
+      for (int i = 1; i + 1 < counts[src]; ++i) {
+         setupTriangle(poly[0], poly[i], poly[i + 1]);
+      }
+   }
+
+   void setupTriangle(ClipVertex const &c0, ClipVertex const &c1, ClipVertex const &c2) {
+      float x[3], y[3], z[3];
+      ClipVertex const *clip[3] = { &c0, &c1, &c2 };
+      for (int i = 0; i < 3; ++i) {
+         z[i] = 1.0f / clip[i]->w;
+         x[i] = (clip[i]->x * z[i] * 0.5f + 0.5f) * m_width;
+         y[i] = (clip[i]->y * z[i] * 0.5f + 0.5f) * m_height;
+      }
+
+      //both windings are drawn, open occluders like the track are seen from either side
+      float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+      if (area == 0.0f) {
+         return;
+      }
+      if (area < 0.0f) {
+         std::swap(x[1], x[2]);
+         std::swap(y[1], y[2]);
+         std::swap(z[1], z[2]);
+         area = -area;
+      }
+
+      Triangle t;
+      t.x0 = std::max(0, (int)ceilf(std::min({ x[0], x[1], x[2] }) - 0.5f));
+      t.y0 = std::max(0, (int)ceilf(std::min({ y[0], y[1], y[2] }) - 0.5f));
+      t.x1 = std::min(m_width - 1, (int)floorf(std::max({ x[0], x[1], x[2] }) - 0.5f));
+      t.y1 = std::min(m_height - 1, (int)floorf(std::max({ y[0], y[1], y[2] }) - 0.5f));
+      if (t.x0 > t.x1 || t.y0 > t.y1) {
+         return;
+      }
+
+      //edge i runs between the two vertices other than i
+      for (int i = 0; i < 3; ++i) {
+         int p = (i + 1) % 3, q = (i + 2) % 3;
+         t.a[i] = y[p] - y[q];
+         t.b[i] = x[q] - x[p];
+         t.c[i] = x[p] * y[q] - y[p] * x[q];
+      }
+
+      float invArea = 1.0f / area;
+      t.za = (t.a[0] * z[0] + t.a[1] * z[1] + t.a[2] * z[2]) * invArea;
+      t.zb = (t.b[0] * z[0] + t.b[1] * z[1] + t.b[2] * z[2]) * invArea;
+      t.zc = (t.c[0] * z[0] + t.c[1] * z[1] + t.c[2] * z[2]) * invArea;
+
+      uint32_t index = (uint32_t)m_triangles.size();
+      m_triangles.push_back(t);
+
+      for (int ty = t.y0 / TileHeight; ty <= t.y1 / TileHeight; ++ty) {
+         for (int tx = t.x0 / TileWidth; tx <= t.x1 / TileWidth; ++tx) {
+            m_bins[ty * m_tilesX + tx].push_back(index);
+         }
+      }
+   }
+
+   void rasterizeTile(int tile) {
+      int tileX = (tile % m_tilesX) * TileWidth;
+      int tileY = (tile / m_tilesX) * TileHeight;
+      float *depth = m_levels[0].data();
+
+      for (auto index : m_bins[tile]) {
+         auto &t = m_triangles[index];
+
+         //tiles are a multiple of 4 wide, so whole groups of 4 never leave the tile
+         int x0 = std::max(t.x0, tileX) & ~3;
+         int x1 = std::min(t.x1, tileX + TileWidth - 1);
+         int y0 = std::max(t.y0, tileY);
+         int y1 = std::min(t.y1, tileY + TileHeight - 1);
+
+         for (int y = y0; y <= y1; ++y) {
+            float py = y + 0.5f;
+            float *row = depth + y * m_width;
+
+#ifdef RSR_SSE
+            __m128 px = _mm_add_ps(_mm_set1_ps(x0 + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+            __m128 e[3], step[3];
+            for (int i = 0; i < 3; ++i) {
+               e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[i]), px), _mm_set1_ps(t.b[i] * py + t.c[i]));
+               step[i] = _mm_set1_ps(t.a[i] * 4.0f);
+            }
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.za), px), _mm_set1_ps(t.zb * py + t.zc));
+            __m128 zStep = _mm_set1_ps(t.za * 4.0f);
+            __m128 zero = _mm_setzero_ps();
+
+            for (int x = x0; x <= x1; x += 4) {
+               __m128 inside = _mm_and_ps(
+                  _mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)),
+                  _mm_cmpge_ps(e[2], zero));
+
+               if (_mm_movemask_ps(inside)) {
+                  __m128 old = _mm_loadu_ps(row + x);
+                  __m128 closer = _mm_max_ps(old, z);
+                  _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, old)));
+               }
+
+               e[0] = _mm_add_ps(e[0], step[0]);
+               e[1] = _mm_add_ps(e[1], step[1]);
+               e[2] = _mm_add_ps(e[2], step[2]);
+               z = _mm_add_ps(z, zStep);
+            }
+#else
+            for (int x = x0; x <= x1; ++x) {
+               float px = x + 0.5f;
+               bool inside = true;
+               for (int i = 0; i < 3 && inside; ++i) {
+                  inside = t.a[i] * px + t.b[i] * py + t.c[i] >= 0.0f;
+               }
+               if (inside) {
+                  row[x] = std::max(row[x], t.za * px + t.zb * py + t.zc);
+               }
+            }
+#endif
+         }
+      }
+   }
+
+   void rasterizeTiles() {
+      int tileCount = m_tilesX * m_tilesY;
+      int tile;
+      while ((tile = m_nextTile++) < tileCount) {
+         rasterizeTile(tile);
+      }
+   }
+
+   void workerLoop() {
+      uint64_t seen = 0;
+
+      for (;;) {
+         {
+            std::unique_lock<std::mutex> lock(m_workMutex);
+            m_workCond.wait(lock, [&]() { return m_stopping || m_generation != seen; });
+            if (m_stopping) {
+               return;
+            }
+            seen = m_generation;
+         }
+
+         rasterizeTiles();
+
+         {
+            std::lock_guard<std::mutex> lock(m_workMutex);
+            if (--m_busyWorkers == 0) {
+               m_doneCond.notify_all();
+            }
+         }
+      }
+   }
+
+   void buildPyramid() {
+      for (size_t level = 1; level < m_levels.size(); ++level) {
+         auto &src = m_levels[level - 1];
+         auto &dst = m_levels[level];
+         int srcWidth = m_levelWidths[level - 1], srcHeight = m_levelHeights[level - 1];
+         int width = m_levelWidths[level], height = m_levelHeights[level];
+
+         for (int y = 0; y < height; ++y) {
+            float const *row0 = src.data() + (y * 2) * srcWidth;
+            float const *row1 = (y * 2 + 1 < srcHeight) ? row0 + srcWidth : row0;
+            float *out = dst.data() + y * width;
+            int x = 0;
+
+#ifdef RSR_SSE
+            for (; x + 4 <= width && (x + 4) * 2 <= srcWidth; x += 4) {
+               __m128 a = _mm_min_ps(_mm_loadu_ps(row0 + x * 2), _mm_loadu_ps(row1 + x * 2));
+               __m128 b = _mm_min_ps(_mm_loadu_ps(row0 + x * 2 + 4), _mm_loadu_ps(row1 + x * 2 + 4));
+               __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+               __m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+               _mm_storeu_ps(out + x, _mm_min_ps(even, odd));
+            }
+#endif
+
+            for (; x < width; ++x) {
+               //odd sizes leave the last texel with only the children that exist
+               int x1 = std::min(x * 2 + 1, srcWidth - 1);
+               out[x] = std::min(std::min(row0[x * 2], row0[x1]), std::min(row1[x * 2], row1[x1]));
+            }
+         }
+      }
+   }
+
+public:
+   Impl(int width, int height, int threadCount) {
+      m_tilesX = std::max(1, (width + TileWidth - 1) / TileWidth);
+      m_tilesY = std::max(1, (height + TileHeight - 1) / TileHeight);
+      m_width = m_tilesX * TileWidth;
+      m_height = m_tilesY * TileHeight;
+      m_bins.resize(m_tilesX * m_tilesY);
+
+      int w = m_width, h = m_height;
+      for (;;) {
+         m_levels.push_back(std::vector<float>(w * h, 0.0f));
+         m_levelWidths.push_back(w);
+         m_levelHeights.push_back(h);
+         if (w == 1 && h == 1) {
+            break;
+         }
+         w = (w + 1) / 2;
+         h = (h + 1) / 2;
+      }
+
+      if (threadCount < 0) {
+         threadCount = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+      }
+      for (int i = 0; i < threadCount; ++i) {
+         m_workers.push_back(std::thread([this]() { workerLoop(); }));
+      }
+   }
+
+   ~Impl() {
+      {
+         std::lock_guard<std::mutex> lock(m_workMutex);
+         m_stopping = true;
+      }
+      m_workCond.notify_all();
+
+      for (auto &t : m_workers) {
+         t.join();
+      }
+   }
+
+   void begin(Matrix const &viewProj) {
+      m_viewProj = viewProj;
+      m_triangles.clear();
+      for (auto &bin : m_bins) {
+         bin.clear();
+      }
+      std::fill(m_levels[0].begin(), m_levels[0].end(), 0.0f);
+   }
+
+   void addOccluder(OccluderMesh const &mesh, Matrix const &transform) {
+      transformVertices(mesh, m_viewProj * transform);
+
+      for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+         clipTriangle(m_clip[mesh.indices[i]], m_clip[mesh.indices[i + 1]], m_clip[mesh.indices[i + 2]]);
+      }
+   }
+
+   void end() {
+      m_nextTile = 0;
+
+      if (m_workers.empty() || m_triangles.size() < ParallelThreshold) {
+         rasterizeTiles();
+      }
+      else {
+         {
+            std::lock_guard<std::mutex> lock(m_workMutex);
+            m_busyWorkers = m_workers.size();
+            ++m_generation;
+         }
+         m_workCond.notify_all();
+
+         //the caller takes tiles too
+         rasterizeTiles();
+
+         std::unique_lock<std::mutex> lock(m_workMutex);
+         m_doneCond.wait(lock, [&]() { return m_busyWorkers == 0; });
+      }
+
+      buildPyramid();
+   }
+
+   bool isVisible(AABB const &box, Matrix const &transform) const {
+      Matrix m = m_viewProj * transform;
+
+      float minX = (float)m_width, minY = (float)m_height, maxX = 0.0f, maxY = 0.0f;
+      float nearest = 0.0f;
+
+      for (int corner = 0; corner < 8; ++corner) {
+         float px = (corner & 1) ? box.max.x : box.min.x;
+         float py = (corner & 2) ? box.max.y : box.min.y;
+         float pz = (corner & 4) ? box.max.z : box.min.z;
+
+         float w = m[3] * px + m[7] * py + m[11] * pz + m[15];
+         if (w < NearW) {
+            return true;
+         }
+
+         float invW = 1.0f / w;
+         float sx = ((m[0] * px + m[4] * py + m[8] * pz + m[12]) * invW * 0.5f + 0.5f) * m_width;
+         float sy = ((m[1] * px + m[5] * py + m[9] * pz + m[13]) * invW * 0.5f + 0.5f) * m_height;
+
+         minX = std::min(minX, sx);
+         minY = std::min(minY, sy);
+         maxX = std::max(maxX, sx);
+         maxY = std::max(maxY, sy);
+         nearest = std::max(nearest, invW);
+      }
+
+      //whatever is off screen is the frustum's call
+      if (maxX < 0.0f || maxY < 0.0f || minX >= m_width || minY >= m_height) {
+         return true;
+      }
+
+      int x0 = std::max(0, (int)minX), y0 = std::max(0, (int)minY);
+      int x1 = std::min(m_width - 1, (int)maxX), y1 = std::min(m_height - 1, (int)maxY);
+
+      //coarsest level where the rect still touches at most 2x2 texels
+      size_t level = 0;
+      while (((x1 >> level) - (x0 >> level)) > 1 || ((y1 >> level) - (y0 >> level)) > 1) {
+         ++level;
+      }
+
+      auto &texels = m_levels[level];
+      int width = m_levelWidths[level];
+      float farthest = std::numeric_limits<float>::max();
+      for (int y = y0 >> level; y <= (y1 >> level); ++y) {
+         for (int x = x0 >> level; x <= (x1 >> level); ++x) {
+            farthest = std::min(farthest, texels[y * width + x]);
+         }
+      }
+
+      return !(nearest * (1.0f + DepthBias) < farthest);
+   }
+
+   int getWidth() const { return m_width; }
+   int getHeight() const { return m_height; }
+   float const *getDepth() const { return m_levels[0].data(); }
+   size_t getTriangleCount() const { return m_triangles.size(); }
+};
+
+OcclusionCuller::OcclusionCuller(int width, int height, int threadCount) :pImpl(new Impl(width, height, threadCount)) {}
+OcclusionCuller::~OcclusionCuller() {}
+
+void OcclusionCuller::begin(Matrix const &viewProj) { pImpl->begin(viewProj); }
+void OcclusionCuller::addOccluder(OccluderMesh const &mesh, Matrix const &transform) { pImpl->addOccluder(mesh, transform); }
+void OcclusionCuller::end() { pImpl->end(); }
+
+bool OcclusionCuller::isVisible(AABB const &box, Matrix const &transform) const { return pImpl->isVisible(box, transform); }
+
+int OcclusionCuller::getWidth() const { return pImpl->getWidth(); }
+int OcclusionCuller::getHeight() const { return pImpl->getHeight(); }
+float const *OcclusionCuller::getDepth() const { return pImpl->getDepth(); }
+size_t OcclusionCuller::getTriangleCount() const { return pImpl->getTriangleCount(); }
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Geom.hpp"
+#include "Model.hpp"
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+//cpu side triangles of something big enough to hide other things behind it, in model space
+//a coarse version does fine as long as it stays inside the real surface
+struct OccluderMesh {
+   std::vector<Float3> positions;
+   std::vector<uint32_t> indices;
+
+   //takes positions and positionIndices, unindexed vertices are read as a plain triangle list
+   static OccluderMesh fromVertices(ModelVertices const &vertices);
+};
+
+// Software occlusion culling against a low resolution depth buffer
+//
+// Occluders are rasterized on the cpu into a buffer of 1/w (bigger is closer, 0 where nothing was drawn),
+// four pixels at a time, with the screen split into tiles that worker threads take one at a time. A min
+// pyramid over it then answers box queries with a handful of reads: a box is hidden when its closest
+// corner is still behind the farthest occluder depth over the pixels it covers.
+//
+// Everything is conservative, triangles crossing the near plane are clipped and boxes that reach behind
+// the camera are always visible. Needs no GPU, so it works the same on the null backend.
+class OcclusionCuller {
+   class Impl;
+   std::unique_ptr<Impl> pImpl;
+
+public:
+   //width and height get rounded up to whole tiles, threadCount < 0 uses a worker per core besides the caller
+   OcclusionCuller(int width = 256, int height = 128, int threadCount = -1);
+   ~OcclusionCuller();
+
+   //clears the buffer, occluders and queries from here on use viewProj
+   void begin(Matrix const &viewProj);
+   //transform is the occluder's model matrix
+   void addOccluder(OccluderMesh const &mesh, Matrix const &transform);
+   //rasterizes everything added since begin and builds the pyramid, call before any isVisible
+   void end();
+
+   //false only when the model space box under transform is certainly behind the occluders
+   bool isVisible(AABB const &box, Matrix const &transform) const;
+
+   int getWidth() const;
+   int getHeight() const;
+   //1/w per pixel of the last end, rows bottom up
+   float const *getDepth() const;
+   size_t getTriangleCount() const;
+};
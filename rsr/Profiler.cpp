@@ -0,0 +1,256 @@
+#ifdef RSR_PROFILE
+
+#include "GLDispatch.hpp"
+#include "Profiler.hpp"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+struct ProfileSample {
+   const char *name;
+   uint64_t begin, end; //ns
+   uint32_t thread;
+};
+
+//samples are appended by the owning thread and collected into the ring at nextFrame
+struct ThreadLog {
+   uint32_t id;
+   const char *name = nullptr;
+
+   std::mutex mutex;
+   std::vector<ProfileSample> samples;
+
+   //zones begun but not ended yet, owning thread only
+   std::vector<ProfileSample> open;
+};
+
+struct ProfileFrame {
+   uint64_t begin, end;
+   std::vector<ProfileSample> samples;
+};
+
+struct GPUQuery {
+   const char *name;
+   GLuint begin, end;
+};
+
+static uint64_t now() {
+   return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class ProfilerState {
+public:
+   //guards the thread list and the ring
+   std::mutex mutex;
+   std::vector<std::unique_ptr<ThreadLog>> threads;
+
+   ProfileFrame frames[Profiler::FrameCount];
+   size_t frameCount = 0;
+   uint64_t frameBegin = now();
+
+   //gpu samples show up as their own thread, the rest is gl thread only
+   ThreadLog *gpuLog;
+   std::vector<GLuint> freeQueries;
+   std::vector<GPUQuery> openGPU, pendingGPU;
+   bool gpuCalibrated = false;
+   int64_t gpuOffset = 0;
+
+   ProfilerState() {
+      gpuLog = addThread();
+      gpuLog->name = "gpu";
+   }
+
+   ThreadLog *addThread() {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      threads.push_back(std::unique_ptr<ThreadLog>(new ThreadLog()));
+      threads.back()->id = (uint32_t)threads.size() - 1;
+      return threads.back().get();
+   }
+};
+
+static ProfilerState &state() {
+   static ProfilerState s;
+   return s;
+}
+
+static thread_local ThreadLog *t_log = nullptr;
+
+static ThreadLog &threadLog() {
+   if (!t_log) {
+      t_log = state().addThread();
+   }
+   return *t_log;
+}
+
+void Profiler::beginZone(const char *name) {
+   auto &log = threadLog();
+   log.open.push_back({ name, now(), 0, log.id });
+}
+
+void Profiler::endZone() {
+   auto &log = threadLog();
+
+   auto sample = log.open.back();
+   log.open.pop_back();
+   sample.end = now();
+
+   std::lock_guard<std::mutex> lock(log.mutex);
+   log.samples.push_back(sample);
+}
+
+void Profiler::beginGPUZone(const char *name) {
+   auto &s = state();
+
+   if (s.freeQueries.size() < 2) {
+      GLuint queries[16];
+      gl::GenQueries(16, queries);
+      s.freeQueries.insert(s.freeQueries.end(), queries, queries + 16);
+   }
+
+   GPUQuery q;
+   q.name = name;
+   q.end = s.freeQueries.back();
+   s.freeQueries.pop_back();
+   q.begin = s.freeQueries.back();
+   s.freeQueries.pop_back();
+
+   gl::QueryCounter(q.begin, GL_TIMESTAMP);
+   s.openGPU.push_back(q);
+}
+
+void Profiler::endGPUZone() {
+   auto &s = state();
+
+   auto q = s.openGPU.back();
+   s.openGPU.pop_back();
+
+   gl::QueryCounter(q.end, GL_TIMESTAMP);
+   s.pendingGPU.push_back(q);
+}
+
+void Profiler::resolveGPU() {
+   auto &s = state();
+
+   //gpu timestamps live on their own clock, line them up with ours once
+   if (!s.gpuCalibrated) {
+      GLint64 gpuNow = 0;
+      gl::GetInteger64v(GL_TIMESTAMP, &gpuNow);
+      s.gpuOffset = (int64_t)now() - (int64_t)gpuNow;
+      s.gpuCalibrated = true;
+   }
+
+   //queries finish in submission order, stop at the first one that's still in flight
+   size_t resolved = 0;
+   for (; resolved < s.pendingGPU.size(); ++resolved) {
+      auto &q = s.pendingGPU[resolved];
+
+      GLint available = 0;
+      gl::GetQueryObjectiv(q.end, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) {
+         break;
+      }
+
+      GLuint64 begin = 0, end = 0;
+      gl::GetQueryObjectui64v(q.begin, GL_QUERY_RESULT, &begin);
+      gl::GetQueryObjectui64v(q.end, GL_QUERY_RESULT, &end);
+
+      ProfileSample sample = {
+         q.name,
+         (uint64_t)((int64_t)begin + s.gpuOffset),
+         (uint64_t)((int64_t)end + s.gpuOffset),
+         s.gpuLog->id };
+
+      {
+         std::lock_guard<std::mutex> lock(s.gpuLog->mutex);
+         s.gpuLog->samples.push_back(sample);
+      }
+
+      s.freeQueries.push_back(q.begin);
+      s.freeQueries.push_back(q.end);
+   }
+
+   s.pendingGPU.erase(s.pendingGPU.begin(), s.pendingGPU.begin() + resolved);
+}
+
+void Profiler::setThreadName(const char *name) {
+   threadLog().name = name;
+}
+
+void Profiler::nextFrame() {
+   auto &s = state();
+   std::lock_guard<std::mutex> lock(s.mutex);
+
+   //the oldest frame gets overwritten, its sample storage is reused
+   auto &frame = s.frames[s.frameCount % FrameCount];
+   frame.samples.clear();
+
+   for (auto && t : s.threads) {
+      std::lock_guard<std::mutex> threadLock(t->mutex);
+      frame.samples.insert(frame.samples.end(), t->samples.begin(), t->samples.end());
+      t->samples.clear();
+   }
+
+   frame.begin = s.frameBegin;
+   frame.end = now();
+   s.frameBegin = frame.end;
+   ++s.frameCount;
+}
+
+//chrome://tracing and perfetto both read this, timestamps are microseconds
+bool Profiler::exportChromeTrace(const char *file) {
+   auto &s = state();
+   std::lock_guard<std::mutex> lock(s.mutex);
+
+   size_t count = s.frameCount < FrameCount ? s.frameCount : FrameCount;
+   if (!count) {
+      return false;
+   }
+
+   FILE *f = fopen(file, "wb");
+   if (!f) {
+      return false;
+   }
+
+   size_t first = s.frameCount - count;
+   uint64_t origin = s.frames[first % FrameCount].begin;
+   auto us = [=](uint64_t t) { return t < origin ? 0.0 : (t - origin) / 1000.0; };
+
+   fprintf(f, "{\"traceEvents\":[\n");
+
+   bool comma = false;
+   for (auto && t : s.threads) {
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"",
+         comma ? ",\n" : "", t->id);
+      if (t->name) {
+         fprintf(f, "%s", t->name);
+      }
+      else {
+         fprintf(f, "thread %u", t->id);
+      }
+      fprintf(f, "\"}}");
+      comma = true;
+   }
+
+   for (size_t i = first; i < s.frameCount; ++i) {
+      auto &frame = s.frames[i % FrameCount];
+
+      fprintf(f, ",\n{\"name\":\"frame %zu\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":%.3f}",
+         i, us(frame.begin));
+
+      for (auto && sample : frame.samples) {
+         fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            sample.name, sample.thread, us(sample.begin), (sample.end - sample.begin) / 1000.0);
+      }
+   }
+
+   fprintf(f, "\n]}\n");
+   fclose(f);
+   return true;
+}
+
+#endif
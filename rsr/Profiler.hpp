@@ -0,0 +1,65 @@
+#pragma once
+
+// Frame profiler, everything here compiles away unless RSR_PROFILE is defined
+//
+//    PROFILE_ZONE("name")      cpu zone until the end of the enclosing scope, nests
+//    PROFILE_GPU_ZONE("name")  gl timestamp queries around the enclosing scope, gl thread only
+//    PROFILE_THREAD("name")    names the calling thread in exported traces
+//    PROFILE_FRAME()           closes the current frame, call once per frame from one thread
+//    PROFILE_EXPORT("file")    writes the frames still in the ring as chrome trace json
+//
+// names must be string literals or otherwise outlive the profiler
+
+#ifdef RSR_PROFILE
+
+#include <stdint.h>
+
+class Profiler {
+public:
+   //frames kept around for export
+   static const size_t FrameCount = 64;
+
+   static void beginZone(const char *name);
+   static void endZone();
+
+   static void beginGPUZone(const char *name);
+   static void endGPUZone();
+   //picks up finished gl queries, called by the renderer after every swap
+   static void resolveGPU();
+
+   static void setThreadName(const char *name);
+   static void nextFrame();
+
+   static bool exportChromeTrace(const char *file);
+};
+
+class ProfileScope {
+public:
+   ProfileScope(const char *name) { Profiler::beginZone(name); }
+   ~ProfileScope() { Profiler::endZone(); }
+};
+
+class GPUProfileScope {
+public:
+   GPUProfileScope(const char *name) { Profiler::beginGPUZone(name); }
+   ~GPUProfileScope() { Profiler::endGPUZone(); }
+};
+
+#define RSR_PROFILE_CONCAT2(a, b) a##b
+#define RSR_PROFILE_CONCAT(a, b) RSR_PROFILE_CONCAT2(a, b)
+
+#define PROFILE_ZONE(name) ProfileScope RSR_PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) GPUProfileScope RSR_PROFILE_CONCAT(_profileGPUZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#define PROFILE_FRAME() Profiler::nextFrame()
+#define PROFILE_EXPORT(file) Profiler::exportChromeTrace(file)
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_FRAME()
+#define PROFILE_EXPORT(file)
+
+#endif
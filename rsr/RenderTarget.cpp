@@ -0,0 +1,114 @@
+#include "RenderTarget.hpp"
+
+#include "GLDispatch.hpp"
+#include "Singleton.hpp"
+
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+//built through the named object calls so nothing the renderer has bound gets disturbed
+class RenderTarget {
+   Int2 m_size;
+   FilterType m_filter;
+   bool m_depth;
+
+   bool m_built = false;
+   GLuint m_framebuffer = 0, m_color = 0, m_depthBuffer = 0;
+
+   void build() {
+      GLint filter = m_filter == FilterType::Nearest ? GL_NEAREST : GL_LINEAR;
+
+      gl::CreateTextures(GL_TEXTURE_2D, 1, &m_color);
+      gl::TextureStorage2D(m_color, 1, GL_RGBA8, m_size.x, m_size.y);
+      gl::TextureParameteri(m_color, GL_TEXTURE_MAG_FILTER, filter);
+      gl::TextureParameteri(m_color, GL_TEXTURE_MIN_FILTER, filter);
+      gl::TextureParameteri(m_color, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      gl::TextureParameteri(m_color, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+      gl::CreateFramebuffers(1, &m_framebuffer);
+      gl::NamedFramebufferTexture(m_framebuffer, GL_COLOR_ATTACHMENT0, m_color, 0);
+
+      if (m_depth) {
+         gl::CreateRenderbuffers(1, &m_depthBuffer);
+         gl::NamedRenderbufferStorage(m_depthBuffer, GL_DEPTH_COMPONENT24, m_size.x, m_size.y);
+         gl::NamedFramebufferRenderbuffer(m_framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+      }
+
+      if (gl::CheckNamedFramebufferStatus(m_framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+         fprintf(stderr, "render target %dx%d is incomplete\n", m_size.x, m_size.y);
+      }
+
+      m_built = true;
+   }
+
+public:
+   RenderTarget(Int2 size, FilterType filter, bool depth) :m_size(size), m_filter(filter), m_depth(depth) {}
+   ~RenderTarget() {
+      if (m_built) {
+         gl::DeleteFramebuffers(1, &m_framebuffer);
+         gl::DeleteTextures(1, &m_color);
+         if (m_depthBuffer) {
+            gl::DeleteRenderbuffers(1, &m_depthBuffer);
+         }
+      }
+   }
+
+   Int2 getSize() { return m_size; }
+   FilterType getFilter() { return m_filter; }
+   bool hasDepth() { return m_depth; }
+
+   GLuint getFramebuffer() {
+      if (!m_built) {
+         build();
+      }
+      return m_framebuffer;
+   }
+
+   void bindColor(TextureSlot slot) {
+      if (!m_built) {
+         build();
+      }
+
+      gl::ActiveTexture(GL_TEXTURE0 + slot);
+      gl::BindTexture(GL_TEXTURE_2D, m_color);
+   }
+};
+
+//destroyed targets wait here until the gl thread deletes them
+class RenderTargetGarbage {
+   std::mutex m_mutex;
+   std::vector<RenderTarget*> m_pending;
+
+public:
+   void push(RenderTarget *rt) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pending.push_back(rt);
+   }
+
+   void collect() {
+      std::vector<RenderTarget*> pending;
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         pending.swap(m_pending);
+      }
+
+      for (auto && rt : pending) {
+         delete rt;
+      }
+   }
+};
+typedef Singleton<RenderTargetGarbage> renderTargetGarbage;
+
+RenderTarget *RenderTargetManager::create(Int2 size, FilterType filter, bool depth) { return new RenderTarget(size, filter, depth); }
+void RenderTargetManager::destroy(RenderTarget *self) { renderTargetGarbage::Instance().push(self); }
+void RenderTargetManager::beginFrame() { renderTargetGarbage::Instance().collect(); }
+Int2 RenderTargetManager::getSize(RenderTarget *self) { return self->getSize(); }
+FilterType RenderTargetManager::getFilter(RenderTarget *self) { return self->getFilter(); }
+bool RenderTargetManager::hasDepth(RenderTarget *self) { return self->hasDepth(); }
+
+void RenderTargetManager::bindFramebuffer(RenderTarget *self, unsigned int windowFramebuffer) {
+   gl::BindFramebuffer(GL_FRAMEBUFFER, self ? self->getFramebuffer() : windowFramebuffer);
+}
+void RenderTargetManager::bindColor(RenderTarget *self, TextureSlot slot) { self->bindColor(slot); }
+unsigned int RenderTargetManager::getFramebuffer(RenderTarget *self) { return self->getFramebuffer(); }
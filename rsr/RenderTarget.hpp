@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Geom.hpp"
+#include "Texture.hpp"
+
+class RenderTarget;
+
+// Offscreen color (RGBA8, sampled with filter) plus an optional depth buffer the renderer can draw into
+// GL objects get made on first use, so targets can be created on any thread
+class RenderTargetManager {
+public:
+   static RenderTarget *create(Int2 size, FilterType filter = FilterType::Linear, bool depth = true);
+   //any thread, the target is deleted at the gl thread's next beginFrame so nothing recorded may still use it
+   static void destroy(RenderTarget *self);
+   static Int2 getSize(RenderTarget *self);
+   static FilterType getFilter(RenderTarget *self);
+   static bool hasDepth(RenderTarget *self);
+
+   //gl thread only
+   //once a frame before anything draws
+   static void beginFrame();
+   //binds the framebuffer for drawing, nullptr draws to windowFramebuffer
+   static void bindFramebuffer(RenderTarget *self, unsigned int windowFramebuffer);
+   //binds the color texture for sampling
+   static void bindColor(RenderTarget *self, TextureSlot slot);
+   static unsigned int getFramebuffer(RenderTarget *self);
+};
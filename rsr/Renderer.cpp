@@ -1,154 +1,712 @@
-#include "GL/glew.h"
+#include "GLDispatch.hpp"
 #include "Renderer.hpp"
 
+#include "Capture.hpp"
 #include "DrawQueue.hpp"
+#include "Profiler.hpp"
+#include "StreamBuffer.hpp"
+#include "TripleBuffer.hpp"
 
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 
+class RenderContext {
+public:
+   std::shared_ptr<DrawQueue> queue;
+   FrameCapture::Buffer *captureSegment = nullptr;
+};
+
+//queue that render functions on this thread record into while a context is active
+static thread_local DrawQueue *t_contextQueue = nullptr;
+
+//shadow copy of the GL state the renderer touches, only used at replay
+//everything starts unknown so the first set of each always reaches GL
+class GLStateCache {
+public:
+   static const int SlotCount = 32;
+
+   RendererStats stats;
+
+   int depthTest = -1, alphaTest = -1, blend = -1;
+   int colorWrite = -1, depthWrite = -1;
+   GLenum depthFunc = 0, alphaFunc = 0, polygonMode = 0;
+   float alphaRef = -1.0f;
+   GLenum blendSrc = 0, blendDst = 0;
+
+   bool viewportValid = false;
+   Recti viewport;
+
+   //nullptr is the window, which is what's bound before the first frame
+   RenderTarget *renderTarget = nullptr;
+
+   Texture *textures[SlotCount];
+   CubeMap *cubeMaps[SlotCount];
+   UBO *ubos[SlotCount];
+
+   GLStateCache() {
+      invalidateBindings();
+   }
+
+   void invalidateBindings() {
+      for (int i = 0; i < SlotCount; ++i) {
+         textures[i] = nullptr;
+         cubeMaps[i] = nullptr;
+         ubos[i] = nullptr;
+      }
+   }
+
+   //true when the value changed and the caller needs to issue the gl call
+   template<typename T>
+   bool set(T &cached, T value) {
+      if (cached == value) {
+         ++stats.filteredStateChanges;
+         return false;
+      }
+
+      cached = value;
+      ++stats.stateChanges;
+      return true;
+   }
+
+   void capability(int &cached, GLenum cap, bool enabled) {
+      if (set(cached, (int)enabled)) {
+         if (enabled) {
+            gl::Enable(cap);
+         }
+         else {
+            gl::Disable(cap);
+         }
+      }
+   }
+};
+
+//the bindings and toggles the recording side last asked for, they're written at the top of every capture so a
+//trace never depends on anything set before it started
+//only calls recorded outside a context update it, contexts are expected to leave state the way they found it
+class RecordedState {
+public:
+   static const int SlotCount = GLStateCache::SlotCount;
+
+   //-1 until the first call
+   int depth = -1, alphaBlending = -1, wireframe = -1, colorWrite = -1, depthWrite = -1;
+
+   bool viewportValid = false;
+   Recti viewport;
+
+   RenderTarget *renderTarget = nullptr;
+   Shader *shader = nullptr;
+
+   //a slot holds either a texture or the color of a render target, cubemaps bind to their own target
+   Texture *textures[SlotCount];
+   RenderTarget *targetColors[SlotCount];
+   CubeMap *cubeMaps[SlotCount];
+   UBO *ubos[SlotCount];
+
+   RecordedState() {
+      for (int i = 0; i < SlotCount; ++i) {
+         textures[i] = nullptr;
+         targetColors[i] = nullptr;
+         cubeMaps[i] = nullptr;
+         ubos[i] = nullptr;
+      }
+   }
+
+   void write(FrameCapture &capture) const {
+      //ubo contents come from the shadow copies, with a render thread that's the last frame it replayed
+      std::vector<byte> contents;
+      for (int i = 0; i < SlotCount; ++i) {
+         if (!ubos[i]) {
+            continue;
+         }
+
+         contents.resize(UBOManager::getSize(ubos[i]));
+         UBOManager::getData(ubos[i], contents.data());
+         capture.setUBOData(ubos[i], 0, contents.size(), contents.data());
+         capture.bindUBO(ubos[i], i);
+      }
+
+      if (renderTarget) {
+         capture.setRenderTarget(renderTarget);
+      }
+      if (viewportValid) {
+         capture.viewport(viewport);
+      }
+
+      if (depth >= 0) { capture.enableDepth(depth != 0); }
+      if (alphaBlending >= 0) { capture.enableAlphaBlending(alphaBlending != 0); }
+      if (wireframe >= 0) { capture.enableWireframe(wireframe != 0); }
+      if (colorWrite >= 0) { capture.enableColorWrite(colorWrite != 0); }
+      if (depthWrite >= 0) { capture.enableDepthWrite(depthWrite != 0); }
+
+      for (int i = 0; i < SlotCount; ++i) {
+         if (textures[i]) {
+            capture.bindTexture(textures[i], i);
+         }
+         if (targetColors[i]) {
+            capture.bindRenderTarget(targetColors[i], i);
+         }
+         if (cubeMaps[i]) {
+            capture.bindCubeMap(cubeMaps[i], i);
+         }
+      }
+
+      if (shader) {
+         capture.setShader(shader);
+      }
+   }
+};
+
 class Renderer::Impl {
-   std::shared_ptr<DrawQueue> m_workingQueue, m_drawQueue;
-   mutable std::mutex m_mutex;
+   //back() is recorded into, front() is replayed
+   TripleBuffer<DrawQueue> m_queues;
+   DrawQueuePool m_queuePool;
+
+   //threaded mode, frame counters are only touched under m_frameMutex
+   std::thread m_renderThread;
+   std::mutex m_frameMutex;
+   std::condition_variable m_frameCond;
+   bool m_threaded, m_stopping;
+   size_t m_maxFramesInFlight;
+   size_t m_framesPublished, m_framesAcquired, m_framesPresented;
+
+   std::vector<std::unique_ptr<RenderContext>> m_contexts;
+   size_t m_contextCount;
 
    Shader *m_activeShader;
    Model *m_activeModel;
 
+   GLStateCache m_state;
+   RendererStats m_lastStats;
+
+   //timestamps around every replayed frame, read back once they're in so nothing ever waits on them
+   struct FrameTimer {
+      GLuint begin, end;
+   };
+   static const size_t MaxFrameTimers = 4;
+   std::vector<FrameTimer> m_freeTimers, m_pendingTimers;
+   double m_gpuFrameTime = 0.0;
+
+   std::unique_ptr<FrameCapture> m_capture;
+   //only touched by the thread that calls finish()
+   RecordedState m_recorded;
+
    Window *m_wnd;
 
-   template <typename L>
-   void draw(L && lambda) {
-      m_workingQueue->push(std::move(lambda));
+   template<typename F>
+   void remember(F const &update) {
+      if (!t_contextQueue) {
+         update(m_recorded);
+      }
+   }
+
+   //frames where every timer is still in flight go unmeasured
+   bool beginFrameTimer(FrameTimer &timer) {
+      if (m_freeTimers.empty()) {
+         if (m_pendingTimers.size() >= MaxFrameTimers) {
+            return false;
+         }
+
+         GLuint queries[2];
+         gl::GenQueries(2, queries);
+         m_freeTimers.push_back({ queries[0], queries[1] });
+      }
+
+      timer = m_freeTimers.back();
+      m_freeTimers.pop_back();
+      gl::QueryCounter(timer.begin, GL_TIMESTAMP);
+      return true;
    }
 
-   std::shared_ptr<DrawQueue> getQueue() const {
-      m_mutex.lock();
-      auto out = m_drawQueue;
-      m_mutex.unlock();
-      return out;
+   void endFrameTimer(FrameTimer const &timer) {
+      gl::QueryCounter(timer.end, GL_TIMESTAMP);
+      m_pendingTimers.push_back(timer);
+   }
+
+   //frames finish in order, stops at the first one that's still in flight
+   void resolveFrameTimers() {
+      size_t resolved = 0;
+      for (; resolved < m_pendingTimers.size(); ++resolved) {
+         auto &timer = m_pendingTimers[resolved];
+
+         GLint available = 0;
+         gl::GetQueryObjectiv(timer.end, GL_QUERY_RESULT_AVAILABLE, &available);
+         if (!available) {
+            break;
+         }
+
+         GLuint64 begin = 0, end = 0;
+         gl::GetQueryObjectui64v(timer.begin, GL_QUERY_RESULT, &begin);
+         gl::GetQueryObjectui64v(timer.end, GL_QUERY_RESULT, &end);
+         m_gpuFrameTime = (end - begin) / 1000000.0;
+
+         m_freeTimers.push_back(timer);
+      }
+
+      m_pendingTimers.erase(m_pendingTimers.begin(), m_pendingTimers.begin() + resolved);
+   }
+
+   int targetHeight(RenderTarget *rt) const {
+      return rt ? RenderTargetManager::getSize(rt).y : (int)m_wnd->getHeight();
+   }
+
+   DrawQueue *recordQueue() {
+      return t_contextQueue ? t_contextQueue : &m_queues.back();
+   }
+
+   //name groups the command's replay in profiles
+   template <typename L>
+   void draw(const char *name, L && lambda) {
+      recordQueue()->push(std::move(lambda), name);
    }
 
 public:
    Impl(Window *wnd):
       m_wnd(wnd),
-      m_workingQueue(new DrawQueue),
-      m_drawQueue(new DrawQueue),
+      m_threaded(false),
+      m_stopping(false),
+      m_maxFramesInFlight(1),
+      m_framesPublished(0),
+      m_framesAcquired(0),
+      m_framesPresented(0),
+      m_contextCount(0),
       m_activeShader(nullptr),
       m_activeModel(nullptr) {}
 
+   ~Impl() {
+      stopRenderThread();
+   }
+
    size_t getWidth() const { return m_wnd->getWidth(); }
    size_t getHeight() const { return m_wnd->getHeight(); }
 
    void finish() {
+      PROFILE_ZONE("Renderer::finish");
+
+      //recorded contexts are owned by the commands that replay them from here on
+      for (size_t i = 0; i < m_contextCount; ++i) {
+         m_contexts[i]->queue.reset();
+      }
+      m_contextCount = 0;
+
+      if (m_capture) {
+         m_capture->save();
+         m_capture.reset();
+      }
+
       //Swap Queues
-      m_mutex.lock();
-      m_drawQueue = std::move(m_workingQueue);
-      m_workingQueue.reset(new DrawQueue());
-      m_mutex.unlock();
+      if (m_threaded) {
+         //wait until the render thread took the last frame so publishing never drops one
+         //and until few enough frames are still waiting to be presented
+         PROFILE_ZONE("wait for render thread");
+         std::unique_lock<std::mutex> lock(m_frameMutex);
+         m_frameCond.wait(lock, [&]() {
+            return m_framesAcquired == m_framesPublished &&
+               m_framesPublished - m_framesPresented < m_maxFramesInFlight;
+         });
+
+         m_queues.publish();
+         ++m_framesPublished;
+         m_frameCond.notify_all();
+      }
+      else {
+         m_queues.publish();
+      }
+
+      //the slot we get back is never the one being replayed, its contexts go back to the pool here
+      m_queues.back().reset();
    }
 
-   void flush() const {
-      getQueue()->draw();
+   void present() {
+      PROFILE_ZONE("Renderer::flush");
+
+      {
+         PROFILE_GPU_ZONE("frame");
+
+         FrameTimer timer;
+         bool timed = beginFrameTimer(timer);
+         ModelManager::beginFrame();
+         RenderTargetManager::beginFrame();
+         UBOManager::beginFrame();
+         m_queues.front().draw();
+         if (timed) {
+            endFrameTimer(timer);
+         }
+      }
       m_wnd->swapBuffers();
+      StreamBuffer::endFrame();
+      resolveFrameTimers();
+
+#ifdef RSR_PROFILE
+      Profiler::resolveGPU();
+#endif
+
+      m_state.stats.droppedFrames = m_queues.dropped();
+      m_state.stats.gpuFrameTime = m_gpuFrameTime;
+
+      std::lock_guard<std::mutex> lock(m_frameMutex);
+      m_lastStats = m_state.stats;
+      m_state.stats = RendererStats();
+   }
+
+   void flush() {
+      //the render thread does this on its own
+      if (m_threaded) {
+         return;
+      }
+
+      //keeps replaying the last frame if nothing new was finished
+      m_queues.acquire();
+      present();
+   }
+
+   void renderLoop() {
+      PROFILE_THREAD("render");
+      beginRender();
+
+      while (true) {
+         {
+            std::unique_lock<std::mutex> lock(m_frameMutex);
+            m_frameCond.wait(lock, [&]() {
+               return m_stopping || m_framesAcquired != m_framesPublished;
+            });
+
+            if (m_stopping) {
+               break;
+            }
+
+            m_queues.acquire();
+            ++m_framesAcquired;
+            m_frameCond.notify_all();
+         }
+
+         present();
+
+         std::lock_guard<std::mutex> lock(m_frameMutex);
+         ++m_framesPresented;
+         m_frameCond.notify_all();
+      }
+
+      m_wnd->endRender();
+   }
+
+   void startRenderThread(int maxFramesInFlight) {
+      if (m_threaded) {
+         return;
+      }
+
+      //only two finished frames fit between the recording and presenting slots
+      m_maxFramesInFlight = maxFramesInFlight < 1 ? 1 : maxFramesInFlight > 2 ? 2 : maxFramesInFlight;
+      m_stopping = false;
+      m_threaded = true;
+
+      //the context can only be current on one thread
+      m_wnd->endRender();
+      m_renderThread = std::thread([this]() { renderLoop(); });
+   }
+
+   void stopRenderThread() {
+      if (!m_threaded) {
+         return;
+      }
+
+      {
+         std::lock_guard<std::mutex> lock(m_frameMutex);
+         m_stopping = true;
+         m_frameCond.notify_all();
+      }
+
+      m_renderThread.join();
+      m_threaded = false;
+
+      //resources created through the managers get destroyed on this thread from here on
+      beginRender();
+   }
+
+   RendererStats getStats() {
+      std::lock_guard<std::mutex> lock(m_frameMutex);
+      return m_lastStats;
+   }
+
+   void captureFrame(const char *file) {
+      m_capture.reset(new FrameCapture(file, getWidth(), getHeight()));
+      m_recorded.write(*m_capture);
    }
 
    void beginRender() const {
       m_wnd->beginRender();
-      glewInit();
+      gl::load();
 
-      glLineWidth(1.0f);
-      glPointSize(1.0f);
+      gl::LineWidth(1.0f);
+      gl::PointSize(1.0f);
 
       
    }
 
+   RenderContext *createContext() {
+      if (m_contextCount == m_contexts.size()) {
+         m_contexts.push_back(std::unique_ptr<RenderContext>(new RenderContext()));
+      }
+
+      auto ctx = m_contexts[m_contextCount++].get();
+      ctx->queue = m_queuePool.acquire();
+      ctx->captureSegment = m_capture ? m_capture->createContext() : nullptr;
+
+      //stitch the context in by reference, nothing gets copied at finish
+      auto queue = ctx->queue;
+      draw("context", [=]() {
+         PROFILE_GPU_ZONE("context");
+         queue->draw();
+      });
+
+      return ctx;
+   }
+
+   void beginContext(RenderContext *ctx) {
+      t_contextQueue = ctx->queue.get();
+      if (m_capture && ctx->captureSegment) {
+         m_capture->beginContext(ctx->captureSegment);
+      }
+   }
+
+   void endContext() {
+      t_contextQueue = nullptr;
+      if (m_capture) {
+         m_capture->endContext();
+      }
+   }
+
    void enableDepth(bool enabled) {
-      draw([=]() {
+      if (m_capture) {
+         m_capture->enableDepth(enabled);
+      }
+      remember([=](RecordedState &st) { st.depth = enabled; });
+
+      draw("enableDepth", [=]() {
+         auto &st = m_state;
+
+         st.capability(st.depthTest, GL_DEPTH_TEST, enabled);
+         st.capability(st.alphaTest, GL_ALPHA_TEST, enabled);
 
          if (enabled) {
-            glEnable(GL_DEPTH_TEST);
-            glDepthFunc(GL_LEQUAL);
-            glAlphaFunc(GL_GREATER, 0.5);
-            glEnable(GL_ALPHA_TEST);
-         }
-         else {
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_ALPHA_TEST);
+            if (st.set(st.depthFunc, (GLenum)GL_LEQUAL)) {
+               gl::DepthFunc(GL_LEQUAL);
+            }
+
+            bool alphaChanged = st.set(st.alphaFunc, (GLenum)GL_GREATER);
+            alphaChanged = st.set(st.alphaRef, 0.5f) || alphaChanged;
+            if (alphaChanged) {
+               gl::AlphaFunc(GL_GREATER, 0.5);
+            }
          }
       });
    }
 
    void enableAlphaBlending(bool enabled) {
-      draw([=]() {
+      if (m_capture) {
+         m_capture->enableAlphaBlending(enabled);
+      }
+      remember([=](RecordedState &st) { st.alphaBlending = enabled; });
+
+      draw("enableAlphaBlending", [=]() {
+         auto &st = m_state;
+
+         st.capability(st.blend, GL_BLEND, enabled);
 
          if (enabled) {
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-         }
-         else {
-            glDisable(GL_BLEND);
+            bool funcChanged = st.set(st.blendSrc, (GLenum)GL_SRC_ALPHA);
+            funcChanged = st.set(st.blendDst, (GLenum)GL_ONE_MINUS_SRC_ALPHA) || funcChanged;
+            if (funcChanged) {
+               gl::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            }
          }
       });
    }
    void enableWireframe(bool enabled) {
-      draw([=]() {
+      if (m_capture) {
+         m_capture->enableWireframe(enabled);
+      }
+      remember([=](RecordedState &st) { st.wireframe = enabled; });
+
+      draw("enableWireframe", [=]() {
+         GLenum mode = enabled ? GL_LINE : GL_FILL;
+         if (m_state.set(m_state.polygonMode, mode)) {
+            gl::PolygonMode(GL_FRONT_AND_BACK, mode);
+         }
+      });
+   }
 
-         if (enabled) {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+   void enableColorWrite(bool enabled) {
+      if (m_capture) {
+         m_capture->enableColorWrite(enabled);
+      }
+      remember([=](RecordedState &st) { st.colorWrite = enabled; });
+
+      draw("enableColorWrite", [=]() {
+         if (m_state.set(m_state.colorWrite, (int)enabled)) {
+            gl::ColorMask(enabled, enabled, enabled, enabled);
          }
-         else {
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+      });
+   }
+   void enableDepthWrite(bool enabled) {
+      if (m_capture) {
+         m_capture->enableDepthWrite(enabled);
+      }
+      remember([=](RecordedState &st) { st.depthWrite = enabled; });
+
+      draw("enableDepthWrite", [=]() {
+         if (m_state.set(m_state.depthWrite, (int)enabled)) {
+            gl::DepthMask(enabled);
          }
       });
    }
 
    //render functions
    void clear(ColorRGBAf const &c) {
-      draw([=]() {
-         glClearColor(c.r, c.g, c.b, c.a);
-         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      if (m_capture) {
+         m_capture->clear(c);
+      }
+
+      draw("clear", [=]() {
+         gl::ClearColor(c.r, c.g, c.b, c.a);
+         gl::Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
       });
    }
    void viewport(Recti const &r) {
-      int winHeight = m_wnd->getHeight();
-      Recti bounds = {
-         r.top.x,
-         winHeight - r.top.y - height(r),
-         width(r),
-         height(r)
-      };
+      if (m_capture) {
+         m_capture->viewport(r);
+      }
+      remember([&](RecordedState &st) {
+         st.viewport = r;
+         st.viewportValid = true;
+      });
+
+      draw("viewport", [=]() {
+         auto &st = m_state;
+
+         //gl counts up from the bottom, which depends on what's being drawn into
+         Recti bounds = {
+            r.top.x,
+            targetHeight(st.renderTarget) - r.top.y - height(r),
+            width(r),
+            height(r)
+         };
+
+         auto &vp = st.viewport;
+         bool same = st.viewportValid &&
+            vp.top.x == bounds.top.x && vp.top.y == bounds.top.y &&
+            vp.bot.x == bounds.bot.x && vp.bot.y == bounds.bot.y;
+
+         if (same) {
+            ++st.stats.filteredStateChanges;
+            return;
+         }
 
-      draw([=]() {
-         glViewport(bounds.top.x, bounds.top.y, bounds.bot.x, bounds.bot.y);
+         vp = bounds;
+         st.viewportValid = true;
+         ++st.stats.stateChanges;
+         gl::Viewport(bounds.top.x, bounds.top.y, bounds.bot.x, bounds.bot.y);
+      });
+   }
+
+   void setRenderTarget(RenderTarget *rt) {
+      if (m_capture) {
+         m_capture->setRenderTarget(rt);
+      }
+      remember([=](RecordedState &st) { st.renderTarget = rt; });
+
+      draw("setRenderTarget", [=]() {
+         if (m_state.set(m_state.renderTarget, rt)) {
+            RenderTargetManager::bindFramebuffer(rt, m_wnd->getFramebuffer());
+         }
+      });
+   }
+
+   void bindRenderTarget(RenderTarget *rt, TextureSlot slot) {
+      if (m_capture) {
+         m_capture->bindRenderTarget(rt, slot);
+      }
+      remember([=](RecordedState &st) {
+         if (slot < RecordedState::SlotCount) {
+            st.targetColors[slot] = rt;
+            st.textures[slot] = nullptr;
+         }
+      });
+
+      draw("bindRenderTarget", [=]() {
+         RenderTargetManager::bindColor(rt, slot);
+
+         //whatever texture the cache thought was there isn't anymore
+         if (slot < GLStateCache::SlotCount) {
+            m_state.textures[slot] = nullptr;
+         }
+      });
+   }
+
+   void blitRenderTarget(RenderTarget *rt, Recti const &source, Recti const &dest) {
+      if (m_capture) {
+         m_capture->blitRenderTarget(rt, source, dest);
+      }
+
+      draw("blitRenderTarget", [=]() {
+         auto current = m_state.renderTarget;
+         int sourceHeight = targetHeight(rt);
+         int destHeight = targetHeight(current);
+         GLuint destFramebuffer = current ? RenderTargetManager::getFramebuffer(current) : m_wnd->getFramebuffer();
+         GLenum filter = RenderTargetManager::getFilter(rt) == FilterType::Nearest ? GL_NEAREST : GL_LINEAR;
+
+         gl::BlitNamedFramebuffer(RenderTargetManager::getFramebuffer(rt), destFramebuffer,
+            source.top.x, sourceHeight - source.bot.y, source.bot.x, sourceHeight - source.top.y,
+            dest.top.x, destHeight - dest.bot.y, dest.bot.x, destHeight - dest.top.y,
+            GL_COLOR_BUFFER_BIT, filter);
       });
    }
 
    void setShader(Shader *s) {
-      draw([=]() {
-         if (s != m_activeShader) {
+      if (m_capture) {
+         m_capture->setShader(s);
+      }
+      remember([=](RecordedState &st) { st.shader = s; });
+
+      draw("setShader", [=]() {
+         if (m_state.set(m_activeShader, s)) {
             ShaderManager::setActive(s);
-            m_activeShader = s;
          }
       });
    }
-   void setFloat2(StringView u, Float2 const &value) {
-      draw([=]() {
+   //names resolve to handles here so replay never hashes
+   void setFloat2(UniformHandle u, Float2 const &value) {
+      if (m_capture) {
+         m_capture->setFloat2(ShaderManager::getUniformName(u), value);
+      }
+
+      draw("setFloat2", [=]() {
          if (m_activeShader) {
             auto uni = ShaderManager::getUniform(m_activeShader, u);
             ShaderManager::setFloat2(m_activeShader, uni, value);
          }
       });
    }
-   void setMatrix(StringView u, Matrix const &value) {
-      draw([=]() {
+   void setMatrix(UniformHandle u, Matrix const &value) {
+      if (m_capture) {
+         m_capture->setMatrix(ShaderManager::getUniformName(u), value);
+      }
+
+      draw("setMatrix", [=]() {
          if (m_activeShader) {
             auto uni = ShaderManager::getUniform(m_activeShader, u);
             ShaderManager::setMatrix(m_activeShader, uni, value);
          }
       });
    }
-   void setColor(StringView u, ColorRGBAf const &value) {
-      draw([=]() {
+   void setColor(UniformHandle u, ColorRGBAf const &value) {
+      if (m_capture) {
+         m_capture->setColor(ShaderManager::getUniformName(u), value);
+      }
+
+      draw("setColor", [=]() {
          if (m_activeShader) {
             auto uni = ShaderManager::getUniform(m_activeShader, u);
             ShaderManager::setColor(m_activeShader, uni, value);
@@ -156,8 +714,12 @@ public:
       });
    }
 
-   void setTextureSlot(StringView u, TextureSlot const &value) {
-      draw([=]() {
+   void setTextureSlot(UniformHandle u, TextureSlot const &value) {
+      if (m_capture) {
+         m_capture->setTextureSlot(ShaderManager::getUniformName(u), value);
+      }
+
+      draw("setTextureSlot", [=]() {
          if (m_activeShader) {
             auto uni = ShaderManager::getUniform(m_activeShader, u);
             ShaderManager::setTextureSlot(m_activeShader, uni, value);
@@ -166,40 +728,153 @@ public:
    }
 
    void bindTexture(Texture *t, TextureSlot slot) {
-      draw([=]() {
-         TextureManager::bind(t, slot);
+      if (m_capture) {
+         m_capture->bindTexture(t, slot);
+      }
+      remember([=](RecordedState &st) {
+         if (slot < RecordedState::SlotCount) {
+            st.textures[slot] = t;
+            st.targetColors[slot] = nullptr;
+         }
+      });
+
+      draw("bindTexture", [=]() {
+         if (slot >= GLStateCache::SlotCount || m_state.set(m_state.textures[slot], t)) {
+            TextureManager::bind(t, slot);
+         }
       });
    }
 
    void setUBOData(UBO *ubo, size_t offset, size_t size, void *data) {
-      draw([=]() {
-         UBOManager::setData(ubo, offset, size, data);
+      if (m_capture) {
+         m_capture->setUBOData(ubo, offset, size, data);
+      }
+      void *payload = recordQueue()->pushData(data, size);
+      draw("setUBOData", [=]() {
+         UBOManager::setData(ubo, offset, size, payload);
       });
    }
 
    void bindUBO(UBO *ubo, UBOSlot slot) {
-      draw([=]() {
-         UBOManager::bind(ubo, slot);
+      if (m_capture) {
+         m_capture->bindUBO(ubo, slot);
+      }
+      remember([=](RecordedState &st) {
+         if (slot < RecordedState::SlotCount) {
+            st.ubos[slot] = ubo;
+         }
+      });
+
+      draw("bindUBO", [=]() {
+         if (slot >= GLStateCache::SlotCount || m_state.set(m_state.ubos[slot], ubo)) {
+            UBOManager::bind(ubo, slot);
+         }
       });
    }
 
    void bindCubeMap(CubeMap *cm, TextureSlot slot) {
-      draw([=]() {
-         CubeMapManager::bind(cm, slot);
+      if (m_capture) {
+         m_capture->bindCubeMap(cm, slot);
+      }
+      remember([=](RecordedState &st) {
+         if (slot < RecordedState::SlotCount) {
+            st.cubeMaps[slot] = cm;
+         }
+      });
+
+      draw("bindCubeMap", [=]() {
+         if (slot >= GLStateCache::SlotCount || m_state.set(m_state.cubeMaps[slot], cm)) {
+            CubeMapManager::bind(cm, slot);
+         }
+      });
+   }
+
+   void updateModelData(Model *m, void *data, size_t size, size_t vCount) {
+      if (m_capture) {
+         m_capture->updateModelData(m, data, size, vCount);
+      }
+
+      void *payload = recordQueue()->pushData(data, size * vCount);
+      draw("updateModelData", [=]() {
+         ModelManager::updateData(m, payload, size, vCount);
       });
    }
 
    void renderModel(Model *m, ModelManager::RenderType type) {
-      draw([=]() {
-         if (m != m_activeModel) {
+      if (m_capture) {
+         m_capture->renderModel(m, type);
+      }
+
+      draw("renderModel", [=]() {
+         if (m_state.set(m_activeModel, m)) {
             ModelManager::bind(m);
-            m_activeModel = m;
          }
 
          ModelManager::draw(m, type);
       });
    }
 
+   //instances already live in the frame being recorded
+   void recordInstances(Model *m, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+      if (m_capture) {
+         m_capture->renderModelInstanced(m, instances, count, type);
+      }
+
+      draw("renderModelInstanced", [=]() {
+         if (m_state.set(m_activeModel, m)) {
+            ModelManager::bind(m);
+         }
+
+         ModelManager::drawInstanced(m, instances, count, type);
+      });
+   }
+
+   void renderInstances(Model *m, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+      if (!count) {
+         return;
+      }
+
+      auto payload = (ModelInstance const*)recordQueue()->pushData(instances, sizeof(ModelInstance) * count);
+      recordInstances(m, payload, count, type);
+   }
+
+   void renderModelBatch(Model *const *models, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+      if (!count) {
+         return;
+      }
+
+      if (m_capture) {
+         m_capture->renderModelBatch(models, instances, count, type);
+      }
+
+      auto queue = recordQueue();
+      auto modelPayload = (Model *const*)queue->pushData(models, sizeof(Model*) * count);
+      auto instancePayload = (ModelInstance const*)queue->pushData(instances, sizeof(ModelInstance) * count);
+
+      draw("renderModelBatch", [=]() {
+         if (m_state.set(m_activeModel, modelPayload[0])) {
+            ModelManager::bind(modelPayload[0]);
+         }
+
+         ModelManager::drawBatch(modelPayload, instancePayload, count, type);
+      });
+   }
+
+   void renderModelInstanced(Model *m, Matrix const *transforms, ColorRGBAf const *colors, size_t count, ModelManager::RenderType type) {
+      if (!count) {
+         return;
+      }
+
+      //interleave straight into the frame so replay uploads one contiguous block
+      auto instances = (ModelInstance*)recordQueue()->allocData(sizeof(ModelInstance) * count);
+      for (size_t i = 0; i < count; ++i) {
+         instances[i].transform = transforms[i];
+         instances[i].color = colors ? colors[i] : CommonColors::White;
+      }
+
+      recordInstances(m, instances, count, type);
+   }
+
 };
 
 Renderer::Renderer(Window *wnd) :pImpl(new Impl(wnd)){}
@@ -208,27 +883,54 @@ Renderer::~Renderer() {}
 //utility
 void Renderer::finish() { pImpl->finish(); }
 void Renderer::flush() const { pImpl->flush(); }
+RendererStats Renderer::getStats() const { return pImpl->getStats(); }
+void Renderer::captureFrame(const char *file) { pImpl->captureFrame(file); }
 void Renderer::beginRender() const { pImpl->beginRender(); }
+void Renderer::startRenderThread(int maxFramesInFlight) { pImpl->startRenderThread(maxFramesInFlight); }
+void Renderer::stopRenderThread() { pImpl->stopRenderThread(); }
+RenderContext *Renderer::createContext() { return pImpl->createContext(); }
+void Renderer::beginContext(RenderContext *ctx) { pImpl->beginContext(ctx); }
+void Renderer::endContext() { pImpl->endContext(); }
 size_t Renderer::getWidth() const { return pImpl->getWidth(); }
 size_t Renderer::getHeight() const { return pImpl->getHeight(); }
 
 //render functions
 void Renderer::clear(ColorRGBAf const &c) { pImpl->clear(c); }
 void Renderer::viewport(Recti const &r) { pImpl->viewport(r); }
+void Renderer::setRenderTarget(RenderTarget *rt) { pImpl->setRenderTarget(rt); }
+void Renderer::bindRenderTarget(RenderTarget *rt, TextureSlot slot) { pImpl->bindRenderTarget(rt, slot); }
+void Renderer::blitRenderTarget(RenderTarget *rt, Recti const &source, Recti const &dest) { pImpl->blitRenderTarget(rt, source, dest); }
 void Renderer::setShader(Shader *s) { pImpl->setShader(s); }
-void Renderer::setFloat2(StringView u, Float2 const &value) { pImpl->setFloat2(u, value); }
-void Renderer::setMatrix(StringView u, Matrix const &value) { pImpl->setMatrix(u, value); }
-void Renderer::setColor(StringView u, ColorRGBAf const &value) { pImpl->setColor(u, value); }
+void Renderer::setFloat2(StringView u, Float2 const &value) { pImpl->setFloat2(ShaderManager::getUniformHandle(u), value); }
+void Renderer::setMatrix(StringView u, Matrix const &value) { pImpl->setMatrix(ShaderManager::getUniformHandle(u), value); }
+void Renderer::setColor(StringView u, ColorRGBAf const &value) { pImpl->setColor(ShaderManager::getUniformHandle(u), value); }
+void Renderer::setFloat2(UniformHandle u, Float2 const &value) { pImpl->setFloat2(u, value); }
+void Renderer::setMatrix(UniformHandle u, Matrix const &value) { pImpl->setMatrix(u, value); }
+void Renderer::setColor(UniformHandle u, ColorRGBAf const &value) { pImpl->setColor(u, value); }
 
 void Renderer::enableDepth(bool enabled) { pImpl->enableDepth(enabled); }
 void Renderer::enableAlphaBlending(bool enabled) { pImpl->enableAlphaBlending(enabled); }
+void Renderer::enableColorWrite(bool enabled) { pImpl->enableColorWrite(enabled); }
+void Renderer::enableDepthWrite(bool enabled) { pImpl->enableDepthWrite(enabled); }
 void Renderer::enableWireframe(bool enabled) { pImpl->enableWireframe(enabled); }
 
-void Renderer::setTextureSlot(StringView u, TextureSlot const &value){pImpl->setTextureSlot(u, value);}
+void Renderer::setTextureSlot(StringView u, TextureSlot const &value){pImpl->setTextureSlot(ShaderManager::getUniformHandle(u), value);}
+void Renderer::setTextureSlot(UniformHandle u, TextureSlot const &value){pImpl->setTextureSlot(u, value);}
 void Renderer::bindTexture(Texture *t, TextureSlot slot){pImpl->bindTexture(t, slot);}
 
 void Renderer::_setUBOData(UBO *ubo, size_t offset, size_t size, void *data) { pImpl->setUBOData(ubo, offset, size, data); }
 void Renderer::bindUBO(UBO *ubo, UBOSlot slot) { pImpl->bindUBO(ubo, slot); }
 void Renderer::bindCubeMap(CubeMap *cm, TextureSlot slot) { pImpl->bindCubeMap(cm, slot); }
 
-void Renderer::renderModel(Model *m, ModelManager::RenderType type) { pImpl->renderModel(m, type); }
\ No newline at end of file
+void Renderer::_updateModelData(Model *m, void *data, size_t size, size_t vCount) { pImpl->updateModelData(m, data, size, vCount); }
+
+void Renderer::renderModel(Model *m, ModelManager::RenderType type) { pImpl->renderModel(m, type); }
+void Renderer::renderModelInstanced(Model *m, Matrix const *transforms, ColorRGBAf const *colors, size_t count, ModelManager::RenderType type) {
+   pImpl->renderModelInstanced(m, transforms, colors, count, type);
+}
+void Renderer::renderModelBatch(Model *const *models, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+   pImpl->renderModelBatch(models, instances, count, type);
+}
+void Renderer::_renderInstances(Model *m, ModelInstance const *instances, size_t count, ModelManager::RenderType type) {
+   pImpl->renderInstances(m, instances, count, type);
+}
\ No newline at end of file
@@ -12,13 +12,33 @@
 #include "StringView.hpp"
 #include "UBO.hpp"
 #include "CubeMap.hpp"
+#include "RenderTarget.hpp"
 
 
+class RenderContext;
+
+struct RendererStats {
+   //state changes that reached GL vs ones the renderer's state cache skipped
+   size_t stateChanges = 0;
+   size_t filteredStateChanges = 0;
+
+   //finished frames that were replaced before flush got to them, since startup
+   size_t droppedFrames = 0;
+
+   //gpu time to replay a frame in ms, timer results come back a frame or two late so this trails behind
+   //0 until the first one arrives
+   double gpuFrameTime = 0.0;
+};
+
 class Renderer {
    class Impl;
    std::unique_ptr<Impl> pImpl;
 
+   friend class FrameReplay;
+
    void _setUBOData(UBO *ubo, size_t offset, size_t size, void *data);
+   void _updateModelData(Model *m, void *data, size_t size, size_t vCount);
+   void _renderInstances(Model *m, ModelInstance const *instances, size_t count, ModelManager::RenderType type);
 public:
    Renderer(Window *wnd);
    ~Renderer();
@@ -31,19 +51,63 @@ public:
    void flush() const;
    void beginRender() const;
 
+   //threaded mode
+   //call instead of beginRender(), flush() then runs on a render thread that owns the GL context
+   //while the caller simulates and records the next frame, flush() itself becomes a no-op
+   //finish() blocks once maxFramesInFlight finished frames (1 or 2) haven't been presented yet
+   void startRenderThread(int maxFramesInFlight = 1);
+   //presents nothing further and moves the GL context back to the calling thread
+   void stopRenderThread();
+
+   //counters from the last flushed frame
+   RendererStats getStats() const;
+
+   //writes everything recorded from now until the next finish() to a binary trace
+   //the trace starts with the state earlier frames left behind (bindings, toggles, ubo contents) so it
+   //plays back the same on its own, see FrameReplay for playing it back
+   //call from the thread that calls finish()
+   void captureFrame(const char *file);
+
+   //parallel recording
+   //reserves a slot in the frame at this point, its commands replay here no matter when they get recorded
+   //call from the thread that calls finish(), contexts are only valid until the next finish()
+   RenderContext *createContext();
+   //render functions called on this thread record into ctx until endContext()
+   //every context must be ended before finish()
+   void beginContext(RenderContext *ctx);
+   void endContext();
+
    //render functions
    void clear(ColorRGBAf const &c);
+   //relative to the top left of the current render target
    void viewport(Recti const &r);
 
+   //offscreen targets
+   //draws and clears from here on land in rt, nullptr goes back to the window
+   void setRenderTarget(RenderTarget *rt);
+   //samples rt's color, not while rt is the current target
+   void bindRenderTarget(RenderTarget *rt, TextureSlot slot);
+   //copies color from source in rt to dest in the current target, stretched with rt's filter
+   void blitRenderTarget(RenderTarget *rt, Recti const &source, Recti const &dest);
+
    void enableDepth(bool enabled);
    void enableAlphaBlending(bool enabled);
    void enableWireframe(bool enabled);
+   //masks, both start enabled, clear only reaches depth while depth writes are on
+   void enableColorWrite(bool enabled);
+   void enableDepthWrite(bool enabled);
 
    void setShader(Shader *s);
+
+   //uniforms by handle, the StringView versions look the handle up on every call
+   void setFloat2(UniformHandle u, Float2 const &value);
+   void setMatrix(UniformHandle u, Matrix const &value);
+   void setColor(UniformHandle u, ColorRGBAf const &value);
    void setFloat2(StringView u, Float2 const &value);
    void setMatrix(StringView u, Matrix const &value);
    void setColor(StringView u, ColorRGBAf const &value);
 
+   void setTextureSlot(UniformHandle u, TextureSlot const &value);
    void setTextureSlot(StringView u, TextureSlot const &value);
    void bindTexture(Texture *t, TextureSlot slot);
 
@@ -54,6 +118,22 @@ public:
    void bindUBO(UBO *ubo, UBOSlot slot);
    void bindCubeMap(CubeMap *cm, TextureSlot slot);
 
+   //data is copied into the frame at record time, safe to modify right after
+   template<typename FVF>
+   void updateModelData(Model *m, std::vector<FVF> &data) {
+      _updateModelData(m, data.data(), sizeof(FVF), data.size());
+   }
+
    void renderModel(Model *m, ModelManager::RenderType type = ModelManager::Triangles);
+   //one draw for count copies of m, use a shader built with Instanced
+   //transforms replace uModelMatrix, colors multiply uColorTransform and default to white when null
+   //both are copied into the frame at record time
+   void renderModelInstanced(Model *m, Matrix const *transforms, ColorRGBAf const *colors, size_t count,
+      ModelManager::RenderType type = ModelManager::Triangles);
+   //one multi draw indirect for every model, they all have to share a ModelManager::getBatchKey
+   //instances[i] positions and colors models[i], use a shader built with Instanced
+   //both arrays are copied into the frame at record time
+   void renderModelBatch(Model *const *models, ModelInstance const *instances, size_t count,
+      ModelManager::RenderType type = ModelManager::Triangles);
 
 };
@@ -1,19 +1,52 @@
-#include "GL/glew.h"
+#include "GLDispatch.hpp"
 
 #include "Shader.hpp"
 #include "Model.hpp"
+#include "Singleton.hpp"
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <string.h>
 #include <vector>
 #include <unordered_map>
 
+//hands out dense ids for uniform names, shaders and callers on any thread share one table
+class UniformNameTable {
+   mutable std::mutex m_mutex;
+   std::unordered_map<StringView, uint32_t> m_ids;
+   std::vector<StringView> m_names;
+
+public:
+   UniformHandle get(StringView name) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+
+      auto found = m_ids.find(name);
+      if (found == m_ids.end()) {
+         found = m_ids.insert(std::make_pair(name, (uint32_t)m_names.size())).first;
+         m_names.push_back(name);
+      }
+
+      return{ found->second };
+   }
+
+   StringView name(UniformHandle u) const {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return u.id < m_names.size() ? m_names[u.id] : nullptr;
+   }
+};
+typedef Singleton<UniformNameTable> uniformNames;
+
 
 class Shader {
    std::string m_filename;
+   int m_id;
    int m_params;
    bool m_built;
    GLuint m_handle;
-   std::unordered_map<StringView, Uniform> m_uniforms;
+
+   //locations indexed by UniformHandle id, filled from the program's active uniforms at build
+   std::vector<Uniform> m_uniforms;
 
    char *readFullFile(const char *path, long *fsize) {
       char *string;
@@ -36,21 +69,21 @@ class Shader {
       return string;
    }
    unsigned int compile(std::vector<const char*> &lines, int type) {
-      unsigned int handle = glCreateShader(type);
+      unsigned int handle = gl::CreateShader(type);
       if (handle) {
 
          int compileStatus;
          const GLchar **source = lines.data();
-         glShaderSource(handle, lines.size(), lines.data(), nullptr);
-         glCompileShader(handle);
+         gl::ShaderSource(handle, lines.size(), lines.data(), nullptr);
+         gl::CompileShader(handle);
 
-         glGetShaderiv(handle, GL_COMPILE_STATUS, &compileStatus);
+         gl::GetShaderiv(handle, GL_COMPILE_STATUS, &compileStatus);
          if (!compileStatus) {
 
             int infoLen = 0;
-            glGetShaderiv(handle, GL_INFO_LOG_LENGTH, &infoLen);
+            gl::GetShaderiv(handle, GL_INFO_LOG_LENGTH, &infoLen);
             std::vector<GLchar> infoLog(infoLen);
-            glGetShaderInfoLog(handle, infoLen, &infoLen, &infoLog[0]);
+            gl::GetShaderInfoLog(handle, infoLen, &infoLen, &infoLog[0]);
             std::string err = infoLog.data();
 
             return 0;
@@ -60,7 +93,7 @@ class Shader {
       return handle;
    }
    unsigned int link(unsigned int vertex, unsigned int fragment) {
-      int handle = glCreateProgram();
+      int handle = gl::CreateProgram();
       if (handle)
       {
          int linkStatus;
@@ -68,32 +101,66 @@ class Shader {
             return 0;
          }
 
-         glBindAttribLocation(handle, (GLuint)VertexAttribute::Pos2, "aPosition2");
-         glBindAttribLocation(handle, (GLuint)VertexAttribute::Pos3, "aPosition3");
-         glBindAttribLocation(handle, (GLuint)VertexAttribute::Tex2, "aTexCoords");
-         glBindAttribLocation(handle, (GLuint)VertexAttribute::Col4, "aColor");
-         glBindAttribLocation(handle, (GLuint)VertexAttribute::Norm3,"aNormal");
+         gl::BindAttribLocation(handle, (GLuint)VertexAttribute::Pos2, "aPosition2");
+         gl::BindAttribLocation(handle, (GLuint)VertexAttribute::Pos3, "aPosition3");
+         gl::BindAttribLocation(handle, (GLuint)VertexAttribute::Tex2, "aTexCoords");
+         gl::BindAttribLocation(handle, (GLuint)VertexAttribute::Col4, "aColor");
+         gl::BindAttribLocation(handle, (GLuint)VertexAttribute::Norm3,"aNormal");
+         gl::BindAttribLocation(handle, (GLuint)VertexAttribute::InstModel, "aInstanceModel");
+         gl::BindAttribLocation(handle, (GLuint)VertexAttribute::InstCol4, "aInstanceColor");
 
-         glAttachShader(handle, vertex);
-         glAttachShader(handle, fragment);
-         glLinkProgram(handle);
+         gl::AttachShader(handle, vertex);
+         gl::AttachShader(handle, fragment);
+         gl::LinkProgram(handle);
 
-         glGetProgramiv(handle, GL_LINK_STATUS, &linkStatus);
+         gl::GetProgramiv(handle, GL_LINK_STATUS, &linkStatus);
          if (!linkStatus) {
             GLsizei log_length = 0;
             GLchar message[1024];
-            glGetProgramInfoLog(handle, 1024, &log_length, message);
+            gl::GetProgramInfoLog(handle, 1024, &log_length, message);
 
             GLsizei srclen = 0;
             GLchar vsrc[10240], fsrc[10240];
-            glGetShaderSource(vertex, 10240, &srclen, vsrc);
-            glGetShaderSource(fragment, 10240, &srclen, fsrc);
+            gl::GetShaderSource(vertex, 10240, &srclen, vsrc);
+            gl::GetShaderSource(fragment, 10240, &srclen, fsrc);
 
             return 0;
          }
       }
       return handle;
    }
+   //stores the location of every active uniform under its handle
+   void reflectUniforms() {
+      GLint count = 0, maxLength = 0;
+      gl::GetProgramiv(m_handle, GL_ACTIVE_UNIFORMS, &count);
+      gl::GetProgramiv(m_handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+      std::vector<char> name(maxLength + 1);
+      for (GLint i = 0; i < count; ++i) {
+         GLsizei length = 0;
+         GLint size = 0;
+         GLenum type = 0;
+         gl::GetActiveUniform(m_handle, i, (GLsizei)name.size(), &length, &size, &type, name.data());
+
+         //arrays report as "name[0]", the base name addresses the first element
+         if (length > 3 && !strcmp(name.data() + length - 3, "[0]")) {
+            name[length - 3] = 0;
+         }
+
+         //uniform block members have no location of their own
+         GLint location = gl::GetUniformLocation(m_handle, name.data());
+         if (location < 0) {
+            continue;
+         }
+
+         auto u = ShaderManager::getUniformHandle(internString(name.data()));
+         if (u.id >= m_uniforms.size()) {
+            m_uniforms.resize(u.id + 1, (Uniform)-1);
+         }
+         m_uniforms[u.id] = location;
+      }
+   }
+
    void build() {
       long fSize = 0;
       auto file = readFullFile(m_filename.c_str(), &fSize);
@@ -110,6 +177,7 @@ class Shader {
       std::string DiffuseLightingOption = "#define DIFFUSE_LIGHTING\n";
       std::string ColorAttributeOption = "#define COLOR_ATTRIBUTE\n";
       std::string RotationOption = "#define ROTATION\n";
+      std::string InstancedOption = "#define INSTANCED\n";
 
       std::vector<const char*> vertShader, fragShader;
 
@@ -130,6 +198,9 @@ class Shader {
       if (m_params&Rotation) {
          vertShader.push_back(RotationOption.c_str());
       }
+      if (m_params&Instanced) {
+         vertShader.push_back(InstancedOption.c_str());
+      }
       vertShader.push_back(file);
       auto vert = compile(vertShader, GL_VERTEX_SHADER);
 
@@ -150,48 +221,45 @@ class Shader {
       if (handle) {
          m_handle = handle;
          m_built = true;
+         reflectUniforms();
       }
    }
 
 public:
-   Shader(const char *file, int params) :m_filename(file), m_params(params), m_built(false) {}
+   Shader(const char *file, int params) :m_filename(file), m_params(params), m_built(false) {
+      static std::atomic<int> nextID(0);
+      m_id = nextID++;
+   }
    ~Shader() {
    }
 
+   int getID() { return m_id; }
+   const char *getFile() { return m_filename.c_str(); }
+   int getParams() { return m_params; }
+
    void setActive() {
       if (!m_built) {
          build();
       }
-      auto err = glGetError();
-      glUseProgram(m_handle);
-      err = glGetError();
+      auto err = gl::GetError();
+      gl::UseProgram(m_handle);
+      err = gl::GetError();
 
    }
-   Uniform getUniform(const StringView name) {
-      if (!m_built) {
-         return (Uniform)-1;
-      }
-
-      auto found = m_uniforms.find(name);
-      if (found == m_uniforms.end()) {
-         Uniform u = glGetUniformLocation(m_handle, (const char*)name);
-         m_uniforms.insert(std::make_pair(name, u));
-         return u;
-      }
-
-      return found->second;
+   Uniform getUniform(UniformHandle u) {
+      return u.id < m_uniforms.size() ? m_uniforms[u.id] : (Uniform)-1;
    }
    void setFloat2(Uniform u, Float2 const &value) {
-      glUniform2fv(u, 1, (float*)&value);
+      gl::Uniform2fv(u, 1, (float*)&value);
    }
    void setMatrix(Uniform u, Matrix const &value) {
-      glUniformMatrix4fv(u, 1, false, (float*)&value);
+      gl::UniformMatrix4fv(u, 1, false, (float*)&value);
    }
    void setColor(Uniform u, ColorRGBAf const &value) {
-      glUniform4fv(u, 1, (float*)&value);
+      gl::Uniform4fv(u, 1, (float*)&value);
    }
    void setTexSlot(Uniform u, TextureSlot const &value) {
-      glUniform1i(u, value);
+      gl::Uniform1i(u, value);
    }
 };
 
@@ -204,7 +272,13 @@ void ShaderManager::destroy(Shader *self) {
 }
 
 void ShaderManager::setActive(Shader *self) { self->setActive(); }
-Uniform ShaderManager::getUniform(Shader *self, StringView name) { return self->getUniform(name); }
+int ShaderManager::getID(Shader *self) { return self->getID(); }
+const char *ShaderManager::getFile(Shader *self) { return self->getFile(); }
+int ShaderManager::getParams(Shader *self) { return self->getParams(); }
+UniformHandle ShaderManager::getUniformHandle(StringView name) { return uniformNames::Instance().get(name); }
+StringView ShaderManager::getUniformName(UniformHandle u) { return uniformNames::Instance().name(u); }
+Uniform ShaderManager::getUniform(Shader *self, UniformHandle u) { return self->getUniform(u); }
+Uniform ShaderManager::getUniform(Shader *self, StringView name) { return self->getUniform(getUniformHandle(name)); }
 void ShaderManager::setFloat2(Shader *self, Uniform u, Float2 const &value) { self->setFloat2(u, value); }
 void ShaderManager::setMatrix(Shader *self, Uniform u, Matrix const &value) { self->setMatrix(u, value); }
 void ShaderManager::setColor(Shader *self, Uniform u, ColorRGBAf const &value) { self->setColor(u, value); }
@@ -10,12 +10,19 @@
 class Shader;
 typedef uintptr_t Uniform;
 
+//dense id of a uniform name, shared by every shader
+//resolve once with ShaderManager::getUniformHandle and keep it, lookups through it are plain indexing
+struct UniformHandle {
+   uint32_t id;
+};
+
 enum ShaderParams : int {
    DiffuseTexture = 1 << 0,
    Position2D = 1 << 1,
    DiffuseLighting = 1 << 2,
    ColorAttribute = 1 << 3,
-   Rotation = 1 << 4
+   Rotation = 1 << 4,
+   Instanced = 1 << 5 //transform and color come from the instance attributes, see renderModelInstanced
 };
 
 class ShaderManager {
@@ -24,7 +31,16 @@ public:
    static void destroy(Shader *self);
 
    static void setActive(Shader *self);
+   //small sequential id, stable for the life of the shader
+   static int getID(Shader *self);
+   static const char *getFile(Shader *self);
+   static int getParams(Shader *self);
+
+   static UniformHandle getUniformHandle(StringView name);
+   static StringView getUniformName(UniformHandle u);
 
+   //-1 when the shader isn't built yet or has no active uniform by that name
+   static Uniform getUniform(Shader *self, UniformHandle u);
    static Uniform getUniform(Shader *self, StringView name);
    static void setFloat2(Shader *self, Uniform u, Float2 const &value);
    static void setMatrix(Shader *self, Uniform u, Matrix const &value);
@@ -0,0 +1,505 @@
+#include "Simplify.hpp"
+
+#include <algorithm>
+#include <math.h>
+#include <queue>
+#include <string.h>
+#include <thread>
+#include <unordered_map>
+
+//open borders are held by planes this much heavier than a face
+static const double BorderWeight = 10.0;
+
+//sum of squared distances to a set of planes, the upper half of the symmetric 4x4 matrix
+struct Quadric {
+   double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+   void addPlane(double a, double b, double c, double d, double weight) {
+      a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+      b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+      c2 += weight * c * c; cd += weight * c * d;
+      d2 += weight * d * d;
+   }
+
+   Quadric &operator+=(Quadric const &q) {
+      a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+      b2 += q.b2; bc += q.bc; bd += q.bd;
+      c2 += q.c2; cd += q.cd;
+      d2 += q.d2;
+      return *this;
+   }
+
+   double error(Float3 const &p) const {
+      double x = p.x, y = p.y, z = p.z;
+      double out =
+         a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+         b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+         c2 * z * z + 2 * cd * z +
+         d2;
+      return std::max(out, 0.0);
+   }
+};
+
+//moves every vertex at position from onto position to
+struct Collapse {
+   double cost;
+   uint32_t from, to;
+   uint32_t fromVersion, toVersion;
+
+   //priority_queue keeps the largest on top, cheapest collapse goes first
+   bool operator<(Collapse const &rhs) const { return cost > rhs.cost; }
+};
+
+struct PositionHash {
+   size_t operator()(Float3 const &p) const {
+      //fnv-1a
+      size_t out = 2166136261u;
+      auto bytes = (unsigned char const *)&p;
+      for (size_t i = 0; i < sizeof(Float3); ++i) {
+         out = (out ^ bytes[i]) * 16777619u;
+      }
+      return out;
+   }
+};
+
+struct PositionEqual {
+   bool operator()(Float3 const &a, Float3 const &b) const {
+      return !memcmp(&a, &b, sizeof(Float3));
+   }
+};
+
+static Float3 faceCross(Float3 const &a, Float3 const &b, Float3 const &c) {
+   return vec::cross(vec::sub(b, a), vec::sub(c, a));
+}
+
+// Half edge collapses over welded vertices
+// Topology works on positions, each position owns every vertex (wedge) sitting on it. Triangles
+// reference vertices so attributes come through untouched.
+class EdgeCollapser {
+   ModelVertices const &m_vertices;
+
+   std::vector<uint32_t> m_corners;
+   std::vector<uint8_t> m_triAlive;
+   size_t m_triCount;
+
+   std::vector<uint32_t> m_positionOf;
+   std::vector<Float3> m_positions;
+   std::vector<std::vector<uint32_t>> m_positionVertices;
+   std::vector<std::vector<uint32_t>> m_positionTris;
+   std::vector<Quadric> m_quadrics;
+   std::vector<uint32_t> m_versions;
+   std::vector<uint8_t> m_positionAlive;
+
+   std::priority_queue<Collapse> m_queue;
+   double m_maxCost;
+
+   //scratch
+   std::vector<uint32_t> m_neighbours, m_otherNeighbours;
+   std::vector<std::pair<uint32_t, uint32_t>> m_vertexMap;
+
+   uint32_t cornerPosition(uint32_t tri, int corner) const {
+      return m_positionOf[m_corners[tri * 3 + corner]];
+   }
+
+   //-1 when the triangle doesn't touch position
+   int findCorner(uint32_t tri, uint32_t position) const {
+      for (int c = 0; c < 3; ++c) {
+         if (cornerPosition(tri, c) == position) {
+            return c;
+         }
+      }
+      return -1;
+   }
+
+   //drops dead triangles and ones that moved away from position
+   void compactTris(uint32_t position) {
+      auto &tris = m_positionTris[position];
+      size_t out = 0;
+      for (auto t : tris) {
+         if (m_triAlive[t] && findCorner(t, position) >= 0) {
+            tris[out++] = t;
+         }
+      }
+      tris.resize(out);
+   }
+
+   void gatherNeighbours(uint32_t position, std::vector<uint32_t> &out) const {
+      out.clear();
+      for (auto t : m_positionTris[position]) {
+         if (!m_triAlive[t]) {
+            continue;
+         }
+         for (int c = 0; c < 3; ++c) {
+            uint32_t p = cornerPosition(t, c);
+            if (p != position) {
+               out.push_back(p);
+            }
+         }
+      }
+      std::sort(out.begin(), out.end());
+      out.erase(std::unique(out.begin(), out.end()), out.end());
+   }
+
+   void push(uint32_t from, uint32_t to) {
+      Quadric q = m_quadrics[from];
+      q += m_quadrics[to];
+      m_queue.push({ q.error(m_positions[to]), from, to, m_versions[from], m_versions[to] });
+   }
+
+   void pushNeighbours(uint32_t position) {
+      gatherNeighbours(position, m_neighbours);
+      for (auto n : m_neighbours) {
+         push(position, n);
+         push(n, position);
+      }
+   }
+
+   void buildQuadrics() {
+      struct EdgeUse {
+         uint32_t count, tri;
+      };
+      std::unordered_map<uint64_t, EdgeUse> edges;
+      edges.reserve(m_corners.size());
+
+      for (uint32_t t = 0; t < m_triAlive.size(); ++t) {
+         if (!m_triAlive[t]) {
+            continue;
+         }
+
+         uint32_t p[3] = { cornerPosition(t, 0), cornerPosition(t, 1), cornerPosition(t, 2) };
+         Float3 n = faceCross(m_positions[p[0]], m_positions[p[1]], m_positions[p[2]]);
+         float len = vec::len(n);
+         if (len > 0.0f) {
+            n = vec::mul(n, 1.0f / len);
+            double d = -vec::dot(n, m_positions[p[0]]);
+            for (auto i : p) {
+               m_quadrics[i].addPlane(n.x, n.y, n.z, d, 1.0);
+            }
+         }
+
+         for (int c = 0; c < 3; ++c) {
+            uint32_t a = p[c], b = p[(c + 1) % 3];
+            uint64_t key = ((uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            auto &use = edges[key];
+            ++use.count;
+            use.tri = t;
+         }
+      }
+
+      //edges with a single triangle get a plane through them, perpendicular to that triangle
+      for (auto && e : edges) {
+         if (e.second.count != 1) {
+            continue;
+         }
+
+         uint32_t a = (uint32_t)(e.first >> 32), b = (uint32_t)e.first;
+         uint32_t t = e.second.tri;
+         Float3 n = faceCross(m_positions[cornerPosition(t, 0)], m_positions[cornerPosition(t, 1)], m_positions[cornerPosition(t, 2)]);
+         Float3 edgeNormal = vec::cross(vec::sub(m_positions[b], m_positions[a]), n);
+
+         float len = vec::len(edgeNormal);
+         if (len > 0.0f) {
+            edgeNormal = vec::mul(edgeNormal, 1.0f / len);
+            double d = -vec::dot(edgeNormal, m_positions[a]);
+            m_quadrics[a].addPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, d, BorderWeight);
+            m_quadrics[b].addPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, d, BorderWeight);
+         }
+      }
+   }
+
+   //fills m_vertexMap with where each vertex of from ends up
+   bool canCollapse(uint32_t from, uint32_t to) {
+      //link condition, the only positions both ends share are the far corners of the edge's triangles
+      //anything else would pinch the surface
+      size_t edgeTris = 0;
+      m_vertexMap.clear();
+
+      for (auto t : m_positionTris[from]) {
+         int toCorner = findCorner(t, to);
+         if (!m_triAlive[t] || toCorner < 0) {
+            continue;
+         }
+         ++edgeTris;
+
+         //each vertex of from takes the attributes of the vertex of to across the same triangle
+         //one vertex going to two different places means from sits on a seam that to doesn't follow
+         uint32_t fromVertex = m_corners[t * 3 + findCorner(t, from)];
+         uint32_t toVertex = m_corners[t * 3 + toCorner];
+
+         bool mapped = false;
+         for (auto && m : m_vertexMap) {
+            if (m.first == fromVertex) {
+               if (m.second != toVertex) {
+                  return false;
+               }
+               mapped = true;
+            }
+         }
+         if (!mapped) {
+            m_vertexMap.push_back({ fromVertex, toVertex });
+         }
+      }
+
+      if (!edgeTris) {
+         return false;
+      }
+
+      gatherNeighbours(from, m_neighbours);
+      gatherNeighbours(to, m_otherNeighbours);
+
+      size_t shared = 0;
+      for (size_t i = 0, j = 0; i < m_neighbours.size() && j < m_otherNeighbours.size();) {
+         if (m_neighbours[i] < m_otherNeighbours[j]) {
+            ++i;
+         }
+         else if (m_otherNeighbours[j] < m_neighbours[i]) {
+            ++j;
+         }
+         else {
+            ++shared;
+            ++i;
+            ++j;
+         }
+      }
+      if (shared != edgeTris) {
+         return false;
+      }
+
+      Float3 const &target = m_positions[to];
+      for (auto t : m_positionTris[from]) {
+         int fromCorner = findCorner(t, from);
+         if (!m_triAlive[t] || findCorner(t, to) >= 0) {
+            continue;
+         }
+
+         //vertices of from that never share a triangle with to have nowhere to go
+         uint32_t fromVertex = m_corners[t * 3 + fromCorner];
+         bool mapped = false;
+         for (auto && m : m_vertexMap) {
+            mapped = mapped || m.first == fromVertex;
+         }
+         if (!mapped) {
+            return false;
+         }
+
+         Float3 p[3] = { m_positions[cornerPosition(t, 0)], m_positions[cornerPosition(t, 1)], m_positions[cornerPosition(t, 2)] };
+         Float3 before = faceCross(p[0], p[1], p[2]);
+         p[fromCorner] = target;
+         Float3 after = faceCross(p[0], p[1], p[2]);
+
+         if (vec::dot(before, after) <= 0.0f) {
+            return false;
+         }
+      }
+
+      return true;
+   }
+
+   void collapse(uint32_t from, uint32_t to) {
+      for (auto t : m_positionTris[from]) {
+         if (!m_triAlive[t]) {
+            continue;
+         }
+         if (findCorner(t, to) >= 0) {
+            m_triAlive[t] = 0;
+            --m_triCount;
+            continue;
+         }
+
+         int c = findCorner(t, from);
+         auto &vertex = m_corners[t * 3 + c];
+         for (auto && m : m_vertexMap) {
+            if (m.first == vertex) {
+               vertex = m.second;
+               break;
+            }
+         }
+         m_positionTris[to].push_back(t);
+      }
+
+      m_quadrics[to] += m_quadrics[from];
+      m_positionAlive[from] = 0;
+      std::vector<uint32_t>().swap(m_positionTris[from]);
+      ++m_versions[from];
+      ++m_versions[to];
+
+      compactTris(to);
+      pushNeighbours(to);
+   }
+
+public:
+   EdgeCollapser(ModelVertices const &vertices, std::vector<uint32_t> const &indices)
+      :m_vertices(vertices), m_corners(indices), m_triCount(0), m_maxCost(0.0) {
+      size_t vertexCount = vertices.positions.size();
+      size_t triCount = indices.size() / 3;
+      m_corners.resize(triCount * 3);
+
+      std::unordered_map<Float3, uint32_t, PositionHash, PositionEqual> lookup;
+      lookup.reserve(vertexCount);
+
+      m_positionOf.resize(vertexCount);
+      for (size_t v = 0; v < vertexCount; ++v) {
+         auto found = lookup.find(vertices.positions[v]);
+         if (found == lookup.end()) {
+            found = lookup.insert(std::make_pair(vertices.positions[v], (uint32_t)m_positions.size())).first;
+            m_positions.push_back(vertices.positions[v]);
+            m_positionVertices.emplace_back();
+         }
+         m_positionOf[v] = found->second;
+         m_positionVertices[found->second].push_back((uint32_t)v);
+      }
+
+      size_t positionCount = m_positions.size();
+      m_positionTris.resize(positionCount);
+      m_quadrics.resize(positionCount);
+      m_versions.resize(positionCount);
+      m_positionAlive.assign(positionCount, 1);
+
+      //triangles that are already degenerate never take part
+      m_triAlive.resize(triCount);
+      for (uint32_t t = 0; t < triCount; ++t) {
+         uint32_t a = cornerPosition(t, 0), b = cornerPosition(t, 1), c = cornerPosition(t, 2);
+         m_triAlive[t] = a != b && b != c && a != c;
+         if (m_triAlive[t]) {
+            ++m_triCount;
+            m_positionTris[a].push_back(t);
+            m_positionTris[b].push_back(t);
+            m_positionTris[c].push_back(t);
+         }
+      }
+
+      buildQuadrics();
+
+      for (uint32_t p = 0; p < positionCount; ++p) {
+         gatherNeighbours(p, m_neighbours);
+         for (auto n : m_neighbours) {
+            push(p, n);
+         }
+      }
+   }
+
+   void run(size_t targetTris) {
+      while (m_triCount > targetTris && !m_queue.empty()) {
+         Collapse c = m_queue.top();
+         m_queue.pop();
+
+         if (!m_positionAlive[c.from] || !m_positionAlive[c.to] ||
+            m_versions[c.from] != c.fromVersion || m_versions[c.to] != c.toVersion) {
+            continue;
+         }
+
+         if (!canCollapse(c.from, c.to)) {
+            continue;
+         }
+
+         m_maxCost = std::max(m_maxCost, c.cost);
+         collapse(c.from, c.to);
+      }
+   }
+
+   //compacts whatever vertices are still referenced
+   SimplifiedMesh result() const {
+      SimplifiedMesh out;
+      auto &v = m_vertices;
+      bool hasTextures = !v.textures.empty();
+      bool hasNormals = !v.normals.empty();
+      bool hasColors = !v.colors.empty();
+
+      std::vector<uint32_t> remap(v.positions.size(), UINT32_MAX);
+      for (size_t t = 0; t < m_triAlive.size(); ++t) {
+         if (!m_triAlive[t]) {
+            continue;
+         }
+
+         for (int c = 0; c < 3; ++c) {
+            uint32_t vertex = m_corners[t * 3 + c];
+            if (remap[vertex] == UINT32_MAX) {
+               remap[vertex] = (uint32_t)out.vertices.positions.size();
+               out.vertices.positions.push_back(v.positions[vertex]);
+               if (hasTextures) {
+                  out.vertices.textures.push_back(v.textures[vertex]);
+               }
+               if (hasNormals) {
+                  out.vertices.normals.push_back(v.normals[vertex]);
+               }
+               if (hasColors) {
+                  out.vertices.colors.push_back(v.colors[vertex]);
+               }
+            }
+            out.indices.push_back(remap[vertex]);
+         }
+      }
+
+      out.error = (float)sqrt(m_maxCost);
+      return out;
+   }
+};
+
+static SimplifiedMesh simplifyWelded(ModelVertices const &welded, std::vector<uint32_t> const &indices, float ratio) {
+   size_t target = (size_t)(indices.size() / 3 * std::max(0.0f, std::min(ratio, 1.0f)));
+
+   EdgeCollapser collapser(welded, indices);
+   collapser.run(std::max(target, (size_t)1));
+   return collapser.result();
+}
+
+SimplifiedMesh simplifyMesh(ModelVertices const &source, float ratio) {
+   std::vector<uint32_t> indices;
+   auto welded = source.weld(indices);
+   return simplifyWelded(welded, indices, ratio);
+}
+
+std::vector<SimplifiedMesh> buildLODChain(ModelVertices const &source, std::vector<float> const &ratios) {
+   std::vector<SimplifiedMesh> out(ratios.size() + 1);
+   out[0].vertices = source.weld(out[0].indices);
+
+   //levels only read the welded source, they don't need anything from each other
+   std::vector<std::thread> threads;
+   for (size_t i = 0; i < ratios.size(); ++i) {
+      threads.push_back(std::thread([&out, &ratios, i]() {
+         out[i + 1] = simplifyWelded(out[0].vertices, out[0].indices, ratios[i]);
+      }));
+   }
+
+   for (auto && t : threads) {
+      t.join();
+   }
+
+   return out;
+}
+
+ModelLOD ModelLOD::create(std::vector<SimplifiedMesh> const &chain, int modelOptions) {
+   ModelLOD out;
+   for (auto && level : chain) {
+      out.models.push_back(level.vertices.createModel(level.indices, modelOptions));
+   }
+
+   float radius = 0.0f;
+   if (!out.models.empty()) {
+      auto bounds = ModelManager::getBounds(out.models[0]);
+      radius = bounds.valid ? bounds.sphere.radius : 0.0f;
+   }
+
+   for (auto && level : chain) {
+      out.relativeErrors.push_back(radius > 0.0f ? level.error / radius : 0.0f);
+   }
+
+   return out;
+}
+
+void ModelLOD::destroy() {
+   for (auto m : models) {
+      ModelManager::destroy(m);
+   }
+   models.clear();
+   relativeErrors.clear();
+}
+
+size_t ModelLOD::select(float screenSize, float tolerance) const {
+   for (size_t level = models.size(); level > 1; --level) {
+      if (screenSize * relativeErrors[level - 1] <= tolerance) {
+         return level - 1;
+      }
+   }
+   return 0;
+}
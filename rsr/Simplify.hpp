@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Model.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+// Mesh simplification by quadric edge collapse (Garland & Heckbert 97)
+//
+// Corners are welded into vertices first and vertices sharing a position collapse together. Every
+// collapse moves a vertex onto one of its neighbours, so whatever survives keeps its original
+// normal, texture coordinate and color. Vertices on an attribute seam only collapse along the seam,
+// open borders are held in place by extra planes and collapses that would flip a triangle are skipped.
+
+struct SimplifiedMesh {
+   //one entry per vertex, drawn through indices
+   ModelVertices vertices;
+   std::vector<uint32_t> indices;
+
+   //distance from the original surface of the worst collapse, in model units
+   float error = 0.0f;
+};
+
+//keeps about ratio of the triangles, stops early when nothing else can collapse safely
+SimplifiedMesh simplifyMesh(ModelVertices const &source, float ratio);
+
+//levels[0] is the welded source, then one level per ratio, each simplified from the source on its own thread
+std::vector<SimplifiedMesh> buildLODChain(ModelVertices const &source, std::vector<float> const &ratios);
+
+// One model per level of a chain and the errors that pick between them
+struct ModelLOD {
+   std::vector<Model*> models;
+
+   //level error over the radius of the full detail model, the same at any scale
+   std::vector<float> relativeErrors;
+
+   static ModelLOD create(std::vector<SimplifiedMesh> const &chain, int modelOptions = 0);
+   void destroy();
+
+   //screenSize is the bounding sphere radius as a fraction of half the viewport height
+   //returns the coarsest level whose error stays under tolerance, given in the same units
+   size_t select(float screenSize, float tolerance) const;
+};
@@ -0,0 +1,192 @@
+#include "StreamBuffer.hpp"
+#include "GLDispatch.hpp"
+#include "Singleton.hpp"
+
+//one fence per frame for the last FenceCount frames, anything older is known to be finished
+class FrameFences {
+   static const unsigned int FenceCount = 8;
+
+   GLsync m_fences[FenceCount];
+   uint64_t m_frame;
+
+   static void waitFence(GLsync fence) {
+      while (gl::ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+      }
+   }
+
+public:
+   FrameFences() :m_frame(0) {
+      for (auto && f : m_fences) {
+         f = nullptr;
+      }
+   }
+
+   uint64_t current() const { return m_frame; }
+
+   void endFrame() {
+      auto &slot = m_fences[m_frame % FenceCount];
+
+      //the frame that used this slot last has to be done before we forget about it
+      if (slot) {
+         waitFence(slot);
+         gl::DeleteSync(slot);
+      }
+
+      slot = gl::FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      ++m_frame;
+   }
+
+   bool isDone(uint64_t frame) {
+      if (frame + FenceCount <= m_frame) {
+         return true;
+      }
+      if (frame >= m_frame) {
+         return false;
+      }
+
+      return gl::ClientWaitSync(m_fences[frame % FenceCount], 0, 0) != GL_TIMEOUT_EXPIRED;
+   }
+
+   void wait(uint64_t frame) {
+      if (frame + FenceCount <= m_frame) {
+         return;
+      }
+
+      //written earlier this frame, nothing to wait on yet
+      if (frame >= m_frame) {
+         gl::Finish();
+         return;
+      }
+
+      waitFence(m_fences[frame % FenceCount]);
+   }
+};
+typedef Singleton<FrameFences> frameFences;
+
+static const uint64_t NeverWritten = ~0ull;
+
+static const GLbitfield PersistentFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+static GLuint createPersistent(size_t size, byte **mapped) {
+   GLuint handle;
+   gl::GenBuffers(1, &handle);
+   gl::BindBuffer(GL_COPY_WRITE_BUFFER, handle);
+   gl::BufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, PersistentFlags);
+   *mapped = (byte*)gl::MapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, PersistentFlags);
+   gl::BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+   return handle;
+}
+
+static void destroyPersistent(GLuint handle) {
+   gl::BindBuffer(GL_COPY_WRITE_BUFFER, handle);
+   gl::UnmapBuffer(GL_COPY_WRITE_BUFFER);
+   gl::BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+   gl::DeleteBuffers(1, &handle);
+}
+
+StreamBuffer::StreamBuffer(size_t sectionSize) :m_sectionSize(sectionSize), m_current(SectionCount - 1), m_written(false) {
+   //sections stay at 256 byte boundaries so offsets work for any binding point
+   m_sectionSize = (m_sectionSize + 255) & ~(size_t)255;
+   m_handle = createPersistent(m_sectionSize * SectionCount, &m_mapped);
+
+   for (auto && f : m_sectionFrame) {
+      f = NeverWritten;
+   }
+}
+
+StreamBuffer::~StreamBuffer() {
+   destroyPersistent(m_handle);
+}
+
+byte *StreamBuffer::beginWrite() {
+   auto &fences = frameFences::Instance();
+
+   unsigned int next = (m_current + 1) % SectionCount;
+   if (m_sectionFrame[next] != NeverWritten) {
+      fences.wait(m_sectionFrame[next]);
+   }
+
+   m_current = next;
+   m_sectionFrame[next] = fences.current();
+   m_written = true;
+   return m_mapped + getOffset();
+}
+
+void StreamBuffer::endFrame() {
+   frameFences::Instance().endFrame();
+}
+
+uint64_t StreamBuffer::currentFrame() {
+   return frameFences::Instance().current();
+}
+
+bool StreamBuffer::isFrameDone(uint64_t frame) {
+   return frameFences::Instance().isDone(frame);
+}
+
+StreamRing::StreamRing(size_t partitionSize) :m_handle(0), m_frame(frameFences::Instance().current()) {
+   create(partitionSize);
+}
+
+StreamRing::~StreamRing() {
+   for (auto && r : m_retired) {
+      destroyPersistent(r.handle);
+   }
+   destroyPersistent(m_handle);
+}
+
+void StreamRing::create(size_t partitionSize) {
+   m_partitionSize = (partitionSize + 255) & ~(size_t)255;
+   m_handle = createPersistent(m_partitionSize * StreamBuffer::SectionCount, &m_mapped);
+
+   for (auto && f : m_partitionFrame) {
+      f = NeverWritten;
+   }
+   m_partition = 0;
+   m_head = 0;
+}
+
+void StreamRing::nextFrame() {
+   auto &fences = frameFences::Instance();
+
+   m_frame = fences.current();
+   m_partition = (m_partition + 1) % StreamBuffer::SectionCount;
+   m_head = 0;
+
+   if (m_partitionFrame[m_partition] != NeverWritten) {
+      fences.wait(m_partitionFrame[m_partition]);
+   }
+
+   for (size_t i = 0; i < m_retired.size();) {
+      if (fences.isDone(m_retired[i].frame)) {
+         destroyPersistent(m_retired[i].handle);
+         m_retired[i] = m_retired.back();
+         m_retired.pop_back();
+      }
+      else {
+         ++i;
+      }
+   }
+}
+
+StreamRing::Allocation StreamRing::alloc(size_t size, size_t alignment) {
+   if (frameFences::Instance().current() != m_frame) {
+      nextFrame();
+   }
+
+   size_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+   if (offset + size > m_partitionSize) {
+      //this frame has already written to the old buffer, it goes once this frame is done
+      m_retired.push_back({ m_handle, m_frame });
+
+      size_t grown = m_partitionSize * 2;
+      create(grown < size ? size : grown);
+      offset = 0;
+   }
+
+   m_partitionFrame[m_partition] = m_frame;
+   m_head = offset + size;
+
+   size_t bufferOffset = m_partition * m_partitionSize + offset;
+   return{ m_handle, bufferOffset, m_mapped + bufferOffset };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "GL/glew.h"
+#include "Defs.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+// Persistently mapped, coherent buffer split into SectionCount equally sized sections
+// Every write goes to the next section, so the gpu can keep reading the ones written in earlier
+// frames. A section is only handed out again once the frame that last wrote it has been fenced
+// off and finished. gl thread only.
+class StreamBuffer {
+public:
+   static const unsigned int SectionCount = 3;
+
+private:
+   GLuint m_handle;
+   byte *m_mapped;
+   size_t m_sectionSize;
+
+   uint64_t m_sectionFrame[SectionCount];
+   unsigned int m_current;
+   bool m_written;
+
+public:
+   StreamBuffer(size_t sectionSize);
+   ~StreamBuffer();
+
+   //waits until the next section is free and returns it for writing, it becomes the current section
+   byte *beginWrite();
+
+   //false until the first beginWrite
+   bool hasData() const { return m_written; }
+
+   GLuint getHandle() const { return m_handle; }
+   size_t getOffset() const { return m_current * m_sectionSize; }
+
+   //fences off everything submitted this frame, call once per frame after the swap
+   static void endFrame();
+   //goes up by one with every endFrame
+   static uint64_t currentFrame();
+   //true once everything submitted during frame has finished on the gpu
+   static bool isFrameDone(uint64_t frame);
+};
+
+// Persistently mapped ring for many small writes per frame
+// Every frame suballocates from its own partition, a partition is reused once the frame that filled
+// it has finished. A frame that runs out of room moves everything to a buffer twice the size, the
+// old one is deleted once the frames reading from it are done. gl thread only.
+class StreamRing {
+public:
+   struct Allocation {
+      GLuint handle;
+      size_t offset;
+      byte *data;
+   };
+
+private:
+   struct Retired {
+      GLuint handle;
+      uint64_t frame;
+   };
+
+   GLuint m_handle;
+   byte *m_mapped;
+   size_t m_partitionSize;
+
+   uint64_t m_partitionFrame[StreamBuffer::SectionCount];
+   unsigned int m_partition;
+   size_t m_head;
+   uint64_t m_frame;
+
+   std::vector<Retired> m_retired;
+
+   void create(size_t partitionSize);
+   void nextFrame();
+
+public:
+   StreamRing(size_t partitionSize);
+   ~StreamRing();
+
+   //alignment has to be a power of two no larger than 256
+   Allocation alloc(size_t size, size_t alignment);
+};
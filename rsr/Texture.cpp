@@ -1,4 +1,4 @@
-#include "GL/glew.h"
+#include "GLDispatch.hpp"
 
 #include "Texture.hpp"
 #include "libpng/png.h"
@@ -9,7 +9,9 @@
 #include "Singleton.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <memory>
+#include <stdexcept>
 #include <unordered_map>
 
 
@@ -32,14 +34,14 @@ size_t TextureRequest::hash() const {
 TextureBuffer loadPng(std::string const& textureFile) {
    FILE* infile = fopen(textureFile.c_str(), "rb");
    if (!infile) {
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    unsigned char sig[8];
    fread(sig, 1, 8, infile);
    if (!png_check_sig(sig, 8)) {
       fclose(infile);
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    png_structp png_ptr;
@@ -49,27 +51,27 @@ TextureBuffer loadPng(std::string const& textureFile) {
    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
    if (!png_ptr) {
       fclose(infile);
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    info_ptr = png_create_info_struct(png_ptr);
    if (!info_ptr) {
       png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
       fclose(infile);
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    end_ptr = png_create_info_struct(png_ptr);
    if (!end_ptr) {
       png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
       fclose(infile);
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    if (setjmp(png_jmpbuf(png_ptr))) {
       png_destroy_read_struct(&png_ptr, &info_ptr, &end_ptr);
       fclose(infile);
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    png_ptr->io_ptr = (png_voidp)infile;
@@ -112,14 +114,14 @@ TextureBuffer loadPng(std::string const& textureFile) {
 
    if ((image_data = new ColorRGBA[totalSize / 4]) == NULL) {
       png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    if ((row_pointers = (png_bytepp)malloc(height*sizeof(png_bytep))) == NULL) {
       png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
       free(image_data);
       image_data = NULL;
-      throw std::exception("failed to load texture.");
+      throw std::runtime_error("failed to load texture.");
    }
 
    for (unsigned int i = 0; i < height; ++i) {
@@ -148,12 +150,19 @@ TextureBuffer loadPng(std::string const& textureFile) {
 }
 
 class Texture {
+   int m_id;
    bool m_isLoaded;
    const TextureRequest m_request;
    GLuint m_glHandle;
    TextureBuffer m_buffer;
 public:
-   Texture(TextureRequest const &request) :m_isLoaded(false), m_glHandle(-1), m_request(request) {}
+   Texture(TextureRequest const &request) :m_isLoaded(false), m_glHandle(-1), m_request(request) {
+      static std::atomic<int> nextID(0);
+      m_id = nextID++;
+   }
+
+   int getID() { return m_id; }
+   TextureRequest const &getRequest() { return m_request; }
 
    void acquire() {
       if (!m_request.path)
@@ -161,44 +170,44 @@ public:
 
       m_buffer = std::move(loadPng((const char*)m_request.path));
 
-      glEnable(GL_TEXTURE_2D);
-      glGenTextures(1, &m_glHandle);
-      glBindTexture(GL_TEXTURE_2D, m_glHandle);
-      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      gl::Enable(GL_TEXTURE_2D);
+      gl::GenTextures(1, &m_glHandle);
+      gl::BindTexture(GL_TEXTURE_2D, m_glHandle);
+      gl::PixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
       switch (m_request.filterType)
       {
       case FilterType::Linear:
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
          break;
       case FilterType::Nearest:
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
          break;
       };
 
       switch (m_request.repeatType)
       {
       case RepeatType::Repeat:
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
          break;
       case RepeatType::Clamp:
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+         gl::TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
          break;
       };
 
-      glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_buffer.size.x, m_buffer.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_buffer.bits.get());
+      gl::TexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+      gl::TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_buffer.size.x, m_buffer.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_buffer.bits.get());
 
-      glBindTexture(GL_TEXTURE_2D, 0);
+      gl::BindTexture(GL_TEXTURE_2D, 0);
 
       m_isLoaded = true;
    }
    void release() {
-      glDeleteTextures(1, &m_glHandle);
+      gl::DeleteTextures(1, &m_glHandle);
       m_buffer.bits.reset();
 
       m_glHandle = 0;
@@ -232,12 +241,16 @@ public:
 typedef Singleton<TextureManagerPrivate> inner;
 
 Texture *TextureManager::get(TextureRequest const &request) { return inner::Instance().get(request); }
+int TextureManager::getID(Texture *self) { return self->getID(); }
+TextureRequest const &TextureManager::getRequest(Texture *self) { return self->getRequest(); }
 
 void TextureManager::bind(Texture *self, TextureSlot slot) {
+   //activate first so anything acquire binds lands on the slot we're about to overwrite
+   gl::ActiveTexture(GL_TEXTURE0 + slot);
+
    if (!self->isLoaded()) {
       self->acquire();
    }
 
-   glActiveTexture(GL_TEXTURE0 + slot);
-   glBindTexture(GL_TEXTURE_2D, self->getHandle());
+   gl::BindTexture(GL_TEXTURE_2D, self->getHandle());
 }
@@ -56,6 +56,9 @@ class Texture;
 class TextureManager{
 public:
    static Texture *get(TextureRequest const &request);
+   //small sequential id, stable for the life of the texture
+   static int getID(Texture *self);
+   static TextureRequest const &getRequest(Texture *self);
    static void bind(Texture *self, TextureSlot slot);
 };
 
@@ -61,11 +61,11 @@ void computeEdges(TrackPoint &p1, TrackPoint &p2, TrackPoint &p3, TrackPoint &p4
    }
 }
 
-Model *createTrackSegment(std::vector<TrackPoint> &pointList, bool wrap) {
+ModelVertices buildTrackSegment(std::vector<TrackPoint> &pointList, bool wrap) {
    int pCount = pointList.size();
 
    if (pCount <= 1) {
-      return nullptr;
+      return ModelVertices();
    }
 
    std::vector<Float3> leftList, rightList;
@@ -121,5 +121,13 @@ Model *createTrackSegment(std::vector<TrackPoint> &pointList, bool wrap) {
       vertices.positionIndices.insert(vertices.positionIndices.end(), {v1, v2, v3, v2, v4, v3});
    }
 
-   return vertices.calculateNormals().expandIndices().createModel(ModelOpts::IncludeNormals);
+   return vertices;
+}
+
+Model *createTrackSegment(ModelVertices vertices) {
+   if (vertices.positions.empty()) {
+      return nullptr;
+   }
+
+   return vertices.calculateNormals().createIndexedModel(ModelOpts::IncludeNormals);
 }
\ No newline at end of file
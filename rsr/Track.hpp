@@ -11,5 +11,7 @@ struct TrackPoint {
       width;
 };
 
-
-Model *createTrackSegment(std::vector<TrackPoint> &pointList, bool wrap);
+//positions and position indices of the segment, empty with fewer than 2 points
+ModelVertices buildTrackSegment(std::vector<TrackPoint> &pointList, bool wrap);
+//indexed model with normals from what buildTrackSegment returned, null when that was empty
+Model *createTrackSegment(ModelVertices vertices);
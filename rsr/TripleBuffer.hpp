@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// Lock-free single producer/single consumer handoff
+// The producer fills back() and publish()es it, the consumer takes the latest published
+// slot with acquire() and reads front(). Neither side ever waits on the other, a published
+// slot that gets replaced before the consumer picks it up is counted as dropped.
+template<typename T>
+class TripleBuffer {
+   static const unsigned int IndexMask = 0x3;
+   static const unsigned int FreshBit = 0x4;
+
+   T m_slots[3];
+
+   //index of the last published slot, FreshBit set until the consumer takes it
+   std::atomic<unsigned int> m_ready;
+   std::atomic<size_t> m_dropped;
+
+   unsigned int m_back; //producer only
+   unsigned int m_front; //consumer only
+
+public:
+   TripleBuffer():m_ready(1), m_dropped(0), m_back(0), m_front(2) {}
+
+   //producer
+   T &back() { return m_slots[m_back]; }
+
+   //hands back() to the consumer, back() is a slot the consumer isn't using afterwards
+   void publish() {
+      unsigned int prev = m_ready.exchange(m_back | FreshBit, std::memory_order_acq_rel);
+      if (prev & FreshBit) {
+         m_dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+      m_back = prev & IndexMask;
+   }
+
+   //consumer
+   T &front() { return m_slots[m_front]; }
+
+   //swaps in the latest published slot, false if nothing new was published since last time
+   bool acquire() {
+      if (!(m_ready.load(std::memory_order_acquire) & FreshBit)) {
+         return false;
+      }
+
+      unsigned int prev = m_ready.exchange(m_front, std::memory_order_acq_rel);
+      m_front = prev & IndexMask;
+      return true;
+   }
+
+   //published slots that were replaced before the consumer got to them
+   size_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+};
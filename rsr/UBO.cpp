@@ -1,51 +1,141 @@
 #include "UBO.hpp"
+#include "StreamBuffer.hpp"
 
-#include "GL/glew.h"
+#include "GLDispatch.hpp"
+
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+class UBO;
+
+//every update gets its own aligned slice of a shared ring, so a ubo can be rewritten any number of
+//times a frame without waiting on draws that still read the previous contents
+class UBORing {
+   StreamRing *m_ring = nullptr;
+   size_t m_alignment = 256;
+
+public:
+   //ubo bound to each slot, so an update can move the binding along with it
+   std::vector<UBO*> slots;
+
+   StreamRing::Allocation alloc(size_t size) {
+      if (!m_ring) {
+         GLint alignment = 0;
+         gl::GetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+         if (alignment > 0) {
+            m_alignment = (size_t)alignment;
+         }
+
+         //never freed, the gl context is gone by the time statics are destroyed
+         m_ring = new StreamRing(64 * 1024);
+      }
+
+      return m_ring->alloc(size, m_alignment);
+   }
+};
+
+static UBORing &uboRing() {
+   static UBORing r;
+   return r;
+}
 
 class UBO {
-   bool m_built = false;
    size_t m_size = 0;
-   uintptr_t m_ubo;
-   
-   void build() {
-      glGenBuffers(1, (GLuint*)&m_ubo);
 
-      glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
-      glBufferData(GL_UNIFORM_BUFFER, m_size, NULL, GL_STATIC_DRAW);
-      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+   //whole contents on the cpu so partial updates can be written out as a full slice
+   std::vector<byte> m_shadow;
+   //only the gl thread writes the shadow, captures read it from the recording side
+   std::mutex m_shadowMutex;
+   //frame of the last upload, the slice is only safe to read during that frame
+   uint64_t m_frame = ~0ull;
 
-      m_built = true;
+   GLuint m_handle = 0;
+   size_t m_offset = 0;
+
+   void bindRange(UBOSlot slot) {
+      gl::BindBufferRange(GL_UNIFORM_BUFFER, (GLuint)slot, m_handle, m_offset, m_size);
+   }
+
+   void upload() {
+      auto &ring = uboRing();
+
+      auto slice = ring.alloc(m_size);
+      memcpy(slice.data, m_shadow.data(), m_size);
+      m_handle = slice.handle;
+      m_offset = slice.offset;
+      m_frame = StreamBuffer::currentFrame();
+
+      for (size_t i = 0; i < ring.slots.size(); ++i) {
+         if (ring.slots[i] == this) {
+            bindRange(i);
+         }
+      }
    }
 
 public:
-   UBO(size_t size):m_size(size) { }
+   UBO(size_t size):m_size(size), m_shadow(size) { }
    ~UBO(){
-      if (m_built) {
-         glDeleteBuffers(1, (GLuint*)&m_ubo);
+      for (auto && s : uboRing().slots) {
+         if (s == this) {
+            s = nullptr;
+         }
       }
    }
-   void setData(UBO *self, size_t offset, size_t size, void *data) {
-      if (!m_built) {
-         build();
+   void setData(size_t offset, size_t size, void *data) {
+      //same as glBufferSubData, a write that doesn't fit is dropped
+      if (offset > m_size || size > m_size - offset) {
+         return; //picnic
       }
 
-      glBindBuffer(GL_UNIFORM_BUFFER, m_ubo);
-      glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
-      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      {
+         std::lock_guard<std::mutex> lock(m_shadowMutex);
+         memcpy(m_shadow.data() + offset, data, size);
+      }
+      upload();
+   }
+
+   void getData(void *out) {
+      std::lock_guard<std::mutex> lock(m_shadowMutex);
+      memcpy(out, m_shadow.data(), m_size);
+   }
+
+   size_t getSize() { return m_size; }
+
+   //writes the contents out again when the last upload came from an earlier frame
+   void refresh() {
+      if (m_frame != StreamBuffer::currentFrame()) {
+         upload();
+      }
    }
 
    void bind(UBOSlot slot) {
-      if (!m_built) {
-         build();
+      refresh();
+
+      auto &slots = uboRing().slots;
+      if (slot >= slots.size()) {
+         slots.resize(slot + 1, nullptr);
       }
+      slots[slot] = this;
 
-      glBindBufferBase(GL_UNIFORM_BUFFER, slot, m_ubo);
+      bindRange(slot);
    }
 };
 
 
 UBO *UBOManager::create(size_t size) { return new UBO(size); }
 void UBOManager::destroy(UBO *self) { delete self; }
+size_t UBOManager::getSize(UBO *self) { return self->getSize(); }
+void UBOManager::getData(UBO *self, void *out) { self->getData(out); }
 
-void UBOManager::setData(UBO *self, size_t offset, size_t size, void *data) { self->setData(self, offset, size, data); }
+void UBOManager::setData(UBO *self, size_t offset, size_t size, void *data) { self->setData(offset, size, data); }
 void UBOManager::bind(UBO *self, UBOSlot slot) { self->bind(slot); }
+
+void UBOManager::beginFrame() {
+   //a refresh rebinds every slot holding that ubo, so each one only gets copied once
+   for (auto && s : uboRing().slots) {
+      if (s) {
+         s->refresh();
+      }
+   }
+}
@@ -12,7 +12,15 @@ class UBOManager {
 public:
    static UBO *create(size_t size);
    static void destroy(UBO *self);
+   static size_t getSize(UBO *self);
+   //copies getSize() bytes of what the gl thread last wrote into out, callable from any thread
+   static void getData(UBO *self, void *out);
 
    static void setData(UBO *self, size_t offset, size_t size, void *data);
    static void bind(UBO *self, UBOSlot slot);
+
+   //gl thread, once a frame before anything draws
+   //the ring slice a ubo was last written to gets handed out again a few frames later, so every bound ubo
+   //that wasn't written yet this frame gets its contents copied into a fresh one
+   static void beginFrame();
 };
\ No newline at end of file
@@ -1,4 +1,4 @@
-#pragma once
+#ifdef _WIN32
 
 #include "Window.hpp"
 
@@ -24,6 +24,7 @@ public:
    HGLRC m_hContext = NULL;
    HINSTANCE m_hInstance = NULL;
    size_t m_width = 0, m_height = 0;
+   int m_flags = 0;
    bool m_shouldClose = false;
 
    Keyboard *m_keyboard;
@@ -93,6 +94,7 @@ public:
 
       m_width = width;
       m_height = height;
+      m_flags = flags;
 
       m_keyboard = Keyboard::create();
       m_mouse = Mouse::create([=]() {return getMousePosition();});
@@ -125,6 +127,16 @@ public:
    size_t getHeight() { return m_height; }
 
    int beginRender() {
+      if (m_flags & NO_CONTEXT) {
+         return 0;
+      }
+
+      //the context already exists, just take it over
+      if (m_hContext) {
+         wglMakeCurrent(m_hdc, m_hContext);
+         return 0;
+      }
+
       PIXELFORMATDESCRIPTOR pfd = { 0 };
       pfd.nSize = sizeof(PIXELFORMATDESCRIPTOR);
       pfd.nVersion = 1;
@@ -152,8 +164,14 @@ public:
       return 0;
    }
 
+   void endRender() {
+      wglMakeCurrent(NULL, NULL);
+   }
+
    void swapBuffers() {
-      SwapBuffers(m_hdc);
+      if (m_hdc) {
+         SwapBuffers(m_hdc);
+      }
    }
 
    Mouse *getMouse() { return m_mouse; }
@@ -398,8 +416,12 @@ size_t  Window::getWidth() { return pImpl->getWidth(); }
 size_t  Window::getHeight() { return pImpl->getHeight(); }
 
 int  Window::beginRender() { return pImpl->beginRender(); }
+void  Window::endRender() { pImpl->endRender(); }
 void  Window::swapBuffers() { pImpl->swapBuffers(); }
 
+unsigned int Window::getFramebuffer() { return 0; }
+unsigned char const *Window::getPixels() { return nullptr; }
+
 Mouse *Window::getMouse() { return pImpl->getMouse(); }
 Keyboard *Window::getKeyboard() { return pImpl->getKeyboard(); }
 
@@ -423,3 +445,5 @@ void Window::destroy(Window *wnd) {
 void Window::close() {
    pImpl->close();
 }
+
+#endif
@@ -14,7 +14,11 @@ private:
    ~Window();
 public:
    enum : int {
-      FULLSCREEN = 1 << 0
+      FULLSCREEN = 1 << 0,
+      //headless only, every swap copies the frame into memory
+      READBACK = 1 << 1,
+      //no gl context at all, for gl::Backend::Null
+      NO_CONTEXT = 1 << 2
    };
 
    static Window *create(size_t width, size_t height, const char *title, int flags);
@@ -29,10 +33,18 @@ public:
    size_t getHeight();
 
    //call in the thread where rendering will take place
+   //calling it again after endRender() moves the context to the calling thread
    int beginRender();
+   //releases the context from the calling thread
+   void endRender();
 
    void swapBuffers();
 
+   //framebuffer that ends up on screen, 0 unless the window is headless, bind this instead of 0
+   unsigned int getFramebuffer();
+   //RGBA rows, bottom up, of the frame from the last swap with READBACK, null otherwise
+   unsigned char const *getPixels();
+
    Mouse *getMouse();
    Keyboard *getKeyboard();
 };
@@ -0,0 +1,41 @@
+layout(std140, binding = 0) uniform uboView{
+    mat4 uViewMatrix;
+};
+
+#ifdef FRAGMENT
+   void main(){
+   }
+#endif
+
+#ifdef VERTEX
+   //the position math has to match shaders.glsl exactly so the color pass lands on the same depth
+   invariant gl_Position;
+
+   uniform mat4 uModelMatrix;
+
+   #ifdef ROTATION
+   uniform mat4 uModelRotation;
+   #endif
+
+   #ifdef INSTANCED
+   in mat4 aInstanceModel;
+   #endif
+
+   in vec3 aPosition3;
+
+   void main() {
+	  vec4 position = vec4(aPosition3, 1);
+
+	  #ifdef INSTANCED
+	  mat4 model = aInstanceModel;
+	  #else
+	  mat4 model = uModelMatrix;
+	  #endif
+
+	  #ifdef ROTATION
+	  model *= uModelRotation;
+	  #endif
+
+      gl_Position = uViewMatrix * (model * position);
+   }
+#endif
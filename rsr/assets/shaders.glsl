@@ -63,6 +63,9 @@ layout(std140, binding = 0) uniform uboView{
 #endif
 
 #ifdef VERTEX
+   //depth.glsl lays down the same depth in the pre-pass
+   invariant gl_Position;
+
    uniform mat4 uModelMatrix;
    uniform vec4 uColorTransform;
 
@@ -70,6 +73,11 @@ layout(std140, binding = 0) uniform uboView{
    uniform mat4 uModelRotation;
    #endif
 
+   #ifdef INSTANCED
+   in mat4 aInstanceModel;
+   in vec4 aInstanceColor;
+   #endif
+
    in vec2 aPosition2;
    in vec3 aPosition3;
    in vec3 aNormal;
@@ -96,8 +104,14 @@ layout(std140, binding = 0) uniform uboView{
 	  vColor = uColorTransform;
 	  #endif
 
+	  #ifdef INSTANCED
+	  vColor *= aInstanceColor;
+	  #endif
+
 	  #ifdef DIFFUSE_LIGHTING
-	     #ifdef ROTATION
+	     #if defined(INSTANCED)
+	     vNormal = normalize(mat3(aInstanceModel) * aNormal);
+	     #elif defined(ROTATION)
 	     vNormal = mat3(uModelRotation) * aNormal;
 	     #else
 	     vNormal = aNormal;
@@ -116,7 +130,11 @@ layout(std140, binding = 0) uniform uboView{
 	  vec4 position = vec4(aPosition3, 1);
       #endif  
 	  
+	  #ifdef INSTANCED
+	  mat4 model = aInstanceModel;
+	  #else
 	  mat4 model = uModelMatrix;
+	  #endif
 	  
 	  #ifdef ROTATION
 	  model *= uModelRotation;
@@ -0,0 +1,47 @@
+#ifdef FRAGMENT
+   out vec4 outColor;
+
+   uniform sampler2D uTexture;
+   in vec2 vTexCoords;
+
+   uniform vec2 uSourceScale;
+   uniform vec2 uSourceOffset;
+   //size of one source texel in uv
+   uniform vec2 uTexelSize;
+   //x is the strength, 0 leaves the plain bilinear stretch
+   uniform vec2 uSharpness;
+
+   vec3 source(vec2 uv) {
+      //everything past the drawn part of the target is left over from older frames
+      vec2 lo = uSourceOffset + uTexelSize * 0.5;
+      vec2 hi = uSourceOffset + uSourceScale - uTexelSize * 0.5;
+      return texture(uTexture, clamp(uv, lo, hi)).rgb;
+   }
+
+   void main() {
+      //unsharp mask against the four neighbours, gives back some of what the stretch blurs
+      vec3 center = source(vTexCoords);
+      vec3 neighbours =
+         source(vTexCoords + vec2(uTexelSize.x, 0.0)) +
+         source(vTexCoords - vec2(uTexelSize.x, 0.0)) +
+         source(vTexCoords + vec2(0.0, uTexelSize.y)) +
+         source(vTexCoords - vec2(0.0, uTexelSize.y));
+
+      vec3 sharpened = center + (center * 4.0 - neighbours) * uSharpness.x;
+      outColor = vec4(clamp(sharpened, 0.0, 1.0), 1.0);
+   }
+#endif
+
+#ifdef VERTEX
+   uniform vec2 uSourceScale;
+   uniform vec2 uSourceOffset;
+
+   in vec2 aPosition2;
+   in vec2 aTexCoords;
+   out vec2 vTexCoords;
+
+   void main() {
+      vTexCoords = aTexCoords * uSourceScale + uSourceOffset;
+      gl_Position = vec4(aPosition2, 0.0, 1.0);
+   }
+#endif
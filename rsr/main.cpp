@@ -1,10 +1,386 @@
 #include "Window.hpp"
+#include "GLDispatch.hpp"
 #include "Renderer.hpp"
 #include "Game.hpp"
+#include "Capture.hpp"
+#include "Profiler.hpp"
+#include "Simplify.hpp"
+#include "DrawQueue.hpp"
+#include "TripleBuffer.hpp"
 
-int main()
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//per frame averages of what the null backend was asked to do, counting starts over afterwards
+static void printGLCounters(int frames) {
+   if (gl::getBackend() != gl::Backend::Null) {
+      return;
+   }
+
+   auto c = gl::getCounters();
+   printf("null gl: %zu calls, %zu draws, %zu state changes, %zu bytes uploaded per frame\n",
+      c.totalCalls() / frames, c.drawCalls / frames, c.stateChanges / frames, c.bytesUploaded / frames);
+   gl::resetCounters();
+}
+
+//plays a captured frame back over and over, reporting the cpu cost of the submission path
+static int runReplay(const char *file, int windowFlags) {
+   Window *win = nullptr;
+
+   {
+      FrameReplay replay;
+      if (!replay.load(file)) {
+         printf("failed to load trace %s\n", file);
+         return 1;
+      }
+
+      win = Window::create(replay.getWidth(), replay.getHeight(), file, windowFlags);
+
+      if (!win) {
+         return 1;
+      }
+
+      Renderer r(win);
+      r.beginRender();
+
+      const int ReportInterval = 100;
+      int frames = 0;
+      size_t commands = 0;
+      double recordTime = 0.0, flushTime = 0.0;
+
+      while (!win->shouldClose()) {
+         auto start = std::chrono::high_resolution_clock::now();
+         commands += replay.replay(r);
+         r.finish();
+         auto recorded = std::chrono::high_resolution_clock::now();
+         r.flush();
+         auto flushed = std::chrono::high_resolution_clock::now();
+
+         recordTime += std::chrono::duration<double, std::milli>(recorded - start).count();
+         flushTime += std::chrono::duration<double, std::milli>(flushed - recorded).count();
+
+         if (++frames == ReportInterval) {
+            auto stats = r.getStats();
+            printf("%zu cmds/frame, record %.3fms, flush %.3fms, gl state changes %zu (%zu filtered)\n",
+               commands / frames, recordTime / frames, flushTime / frames,
+               stats.stateChanges, stats.filteredStateChanges);
+            printGLCounters(frames);
+
+            frames = 0;
+            commands = 0;
+            recordTime = flushTime = 0.0;
+         }
+
+         win->pollEvents();
+
+         PROFILE_FRAME();
+      }
+
+      //replay resources and the renderer go while the context is still around
+   }
+
+   Window::destroy(win);
+   return 0;
+}
+
+//streams a million points per frame through a Stream model, reporting what the upload path costs
+static int runStreamBench(int windowFlags) {
+   Window *win = Window::create(1024, 768, "stream bench", windowFlags);
+
+   if (!win) {
+      return 1;
+   }
+
+   {
+      Renderer r(win);
+      r.beginRender();
+
+      const size_t VertexCount = 1000000;
+      std::vector<FVF_Pos3_Col4> vertices(VertexCount);
+      Model *points = ModelManager::create(vertices, ModelManager::Stream);
+      Shader *shader = ShaderManager::create("assets/shaders.glsl", ColorAttribute);
+      auto uColor = ShaderManager::getUniformHandle(internString("uColorTransform"));
+
+      const int ReportInterval = 100;
+      int frames = 0, frame = 0;
+      double recordTime = 0.0, flushTime = 0.0;
+
+      while (!win->shouldClose()) {
+         for (size_t i = 0; i < VertexCount; ++i) {
+            float t = (float)(i + frame);
+            vertices[i].pos3 = { t, (float)frame, 0.0f };
+            vertices[i].col4 = CommonColors::White;
+         }
+         ++frame;
+
+         auto start = std::chrono::high_resolution_clock::now();
+         r.clear(CommonColors::Black);
+         r.setShader(shader);
+         r.setColor(uColor, CommonColors::White);
+         r.updateModelData(points, vertices);
+         r.renderModel(points, ModelManager::Points);
+         r.finish();
+         auto recorded = std::chrono::high_resolution_clock::now();
+         r.flush();
+         auto flushed = std::chrono::high_resolution_clock::now();
+
+         recordTime += std::chrono::duration<double, std::milli>(recorded - start).count();
+         flushTime += std::chrono::duration<double, std::milli>(flushed - recorded).count();
+
+         if (++frames == ReportInterval) {
+            double mb = sizeof(FVF_Pos3_Col4) * VertexCount / (1024.0 * 1024.0);
+            printf("%zu vertices (%.1fMB)/frame, record %.3fms, flush %.3fms, %.0fMB/s through flush\n",
+               VertexCount, mb, recordTime / frames, flushTime / frames, mb * frames / (flushTime / 1000.0));
+            printGLCounters(frames);
+
+            frames = 0;
+            recordTime = flushTime = 0.0;
+         }
+
+         win->pollEvents();
+      }
+
+      ModelManager::destroy(points);
+      ShaderManager::destroy(shader);
+   }
+
+   Window::destroy(win);
+   return 0;
+}
+
+//builds a lod chain for file one level at a time and then on a thread per level, no window needed
+static int runLODBench(const char *file) {
+   auto vertexSet = ModelVertices::fromOBJ(file);
+   if (vertexSet.empty()) {
+      printf("failed to load %s\n", file);
+      return 1;
+   }
+
+   auto &source = vertexSet[0];
+   if (source.normalIndices.empty()) {
+      source.calculateNormals();
+   }
+
+   std::vector<float> ratios = { 0.5f, 0.25f, 0.1f, 0.02f };
+
+   auto start = std::chrono::high_resolution_clock::now();
+   for (auto ratio : ratios) {
+      auto level = simplifyMesh(source, ratio);
+      printf("%.2f: %zu triangles, %zu vertices, error %f\n",
+         ratio, level.indices.size() / 3, level.vertices.positions.size(), level.error);
+   }
+   auto serial = std::chrono::high_resolution_clock::now();
+   auto chain = buildLODChain(source, ratios);
+   auto threaded = std::chrono::high_resolution_clock::now();
+
+   printf("%zu source triangles, one level at a time %.1fms, thread per level %.1fms\n",
+      chain[0].indices.size() / 3,
+      std::chrono::duration<double, std::milli>(serial - start).count(),
+      std::chrono::duration<double, std::milli>(threaded - serial).count());
+   return 0;
+}
+
+//fills a DrawQueue with CommandCount commands from push and replays it, over and over
+//the first round only grows the pages and isn't counted, the destroy pass counts as replay
+template<typename Push>
+static void benchQueue(const char *name, DrawQueue &queue, Push push) {
+   const size_t CommandCount = 50000;
+   const int Rounds = 100;
+
+   double pushTime = 0.0, replayTime = 0.0;
+   for (int round = 0; round <= Rounds; ++round) {
+      auto start = std::chrono::high_resolution_clock::now();
+      for (size_t i = 0; i < CommandCount; ++i) {
+         push(queue, i);
+      }
+      auto pushed = std::chrono::high_resolution_clock::now();
+      queue.draw();
+      queue.reset();
+      auto replayed = std::chrono::high_resolution_clock::now();
+
+      if (round) {
+         pushTime += std::chrono::duration<double, std::milli>(pushed - start).count();
+         replayTime += std::chrono::duration<double, std::milli>(replayed - pushed).count();
+      }
+   }
+
+   double commands = (double)CommandCount * Rounds;
+   printf("%-12s push %7.1fM cmds/s, replay %7.1fM cmds/s\n", name,
+      commands / (pushTime * 1000.0), commands / (replayTime * 1000.0));
+}
+
+//what recording and replaying draw commands costs without a renderer or gl behind them
+static int runQueueBench() {
+   DrawQueue queue;
+   size_t sink = 0;
+   size_t *out = &sink;
+   auto shared = std::make_shared<size_t>(1);
+
+   //the smallest command there is
+   benchQueue("trivial", queue, [=](DrawQueue &q, size_t i) {
+      q.push([=]() { *out += i; });
+   });
+
+   //about what setMatrix records
+   benchQueue("matrix", queue, [=](DrawQueue &q, size_t i) {
+      Matrix m = Matrix::identity();
+      m[12] = (float)i;
+      q.push([=]() { *out += (size_t)m[12]; });
+   });
+
+   //holds a reference, so every record needs its destructor run
+   benchQueue("non-trivial", queue, [=](DrawQueue &q, size_t i) {
+      q.push([=]() { *out += *shared + i; });
+   });
+
+   return 0;
+}
+
+//a producer publishing through a TripleBuffer as fast as it can while the consumer keeps acquiring
+//every slot is filled with its sequence number, so a torn slot shows up as a mismatch and a slot
+//handed over twice as a sequence that doesn't go up
+static int runTripleBench() {
+   typedef std::chrono::high_resolution_clock Clock;
+
+   struct Frame {
+      uint64_t sequence;
+      Clock::time_point published;
+      uint64_t payload[256];
+   };
+
+   const uint64_t FrameCount = 2000000;
+
+   std::unique_ptr<TripleBuffer<Frame>> buffer(new TripleBuffer<Frame>());
+   std::atomic<bool> done(false);
+
+   std::thread producer([&]() {
+      for (uint64_t seq = 1; seq <= FrameCount; ++seq) {
+         auto &f = buffer->back();
+         f.sequence = seq;
+         for (auto && p : f.payload) {
+            p = seq;
+         }
+         f.published = Clock::now();
+         buffer->publish();
+      }
+      done.store(true, std::memory_order_release);
+   });
+
+   uint64_t last = 0, acquired = 0, skipped = 0, torn = 0, duplicated = 0;
+   std::vector<double> latencies;
+   latencies.reserve((size_t)FrameCount);
+
+   auto check = [&]() {
+      auto &f = buffer->front();
+      auto now = Clock::now();
+
+      for (auto && p : f.payload) {
+         if (p != f.sequence) {
+            ++torn;
+            break;
+         }
+      }
+      if (f.sequence <= last) {
+         ++duplicated;
+      }
+      else {
+         skipped += f.sequence - last - 1;
+         last = f.sequence;
+      }
+
+      ++acquired;
+      latencies.push_back(std::chrono::duration<double, std::micro>(now - f.published).count());
+   };
+
+   auto start = Clock::now();
+   while (!done.load(std::memory_order_acquire)) {
+      if (buffer->acquire()) {
+         check();
+      }
+   }
+   //whatever was published last is still waiting
+   if (buffer->acquire()) {
+      check();
+   }
+   auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+   producer.join();
+
+   std::sort(latencies.begin(), latencies.end());
+   auto percentile = [&](double p) { return latencies.empty() ? 0.0 : latencies[(size_t)(p * (latencies.size() - 1))]; };
+
+   printf("%llu published in %.1fms, %llu acquired, %llu dropped (%llu sequence gaps)\n",
+      (unsigned long long)FrameCount, elapsed, (unsigned long long)acquired,
+      (unsigned long long)buffer->dropped(), (unsigned long long)skipped);
+   printf("publish to acquire: median %.2fus, p99 %.2fus, max %.2fus\n",
+      percentile(0.5), percentile(0.99), percentile(1.0));
+
+   bool ok = !torn && !duplicated && last == FrameCount && skipped == buffer->dropped();
+   printf("%s: %llu torn, %llu duplicated\n", ok ? "ok" : "FAILED", (unsigned long long)torn, (unsigned long long)duplicated);
+   return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
 {
-   Window *win = Window::create(1024, 768, "Test!", 0);
+   //-threaded presents on a render thread while the next frame is simulated
+   bool threaded = false;
+   int maxFramesInFlight = 1;
+   //-frames stops after that many frames and reports the average, for runs without anyone to close the window
+   int frameLimit = 0;
+   int windowFlags = 0;
+
+   //-nullgl runs everything against the counting null backend, no gpu or display needed
+   const char *replayFile = nullptr;
+   bool streamBench = false;
+
+   for (int i = 1; i < argc; ++i) {
+      if (!strcmp(argv[i], "-replay") && i + 1 < argc) {
+         replayFile = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-streambench")) {
+         streamBench = true;
+      }
+      else if (!strcmp(argv[i], "-triplebench")) {
+         return runTripleBench();
+      }
+      else if (!strcmp(argv[i], "-queuebench")) {
+         return runQueueBench();
+      }
+      else if (!strcmp(argv[i], "-lodbench")) {
+         return runLODBench(i + 1 < argc ? argv[i + 1] : "assets/dragon.obj");
+      }
+      else if (!strcmp(argv[i], "-threaded")) {
+         threaded = true;
+      }
+      else if (!strcmp(argv[i], "-inflight") && i + 1 < argc) {
+         maxFramesInFlight = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-frames") && i + 1 < argc) {
+         frameLimit = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-readback")) {
+         windowFlags |= Window::READBACK;
+      }
+      else if (!strcmp(argv[i], "-nullgl")) {
+         gl::setBackend(gl::Backend::Null);
+         windowFlags |= Window::NO_CONTEXT;
+      }
+   }
+
+   if (replayFile) {
+      return runReplay(replayFile, windowFlags);
+   }
+   if (streamBench) {
+      return runStreamBench(windowFlags);
+   }
+
+   Window *win = Window::create(1024, 768, "Test!", windowFlags);
 
    if (!win) {
       return 0;
@@ -13,15 +389,38 @@ int main()
    Renderer r(win);
    Game g(r, win);
 
-   r.beginRender();
+   if (threaded) {
+      r.startRenderThread(maxFramesInFlight);
+   }
+   else {
+      r.beginRender();
+   }
    g.onStartup();   
 
+   PROFILE_THREAD("main");
+
+   int frames = 0;
+   auto start = std::chrono::high_resolution_clock::now();
+   gl::resetCounters();
+
    while (!win->shouldClose()) {      
       g.onStep();
+      r.flush();
       win->pollEvents();
 
+      PROFILE_FRAME();
+
+      if (frameLimit && ++frames == frameLimit) {
+         auto elapsed = std::chrono::high_resolution_clock::now() - start;
+         printf("%d frames, %.3fms/frame, last gpu frame %.3fms\n", frames,
+            std::chrono::duration<double, std::milli>(elapsed).count() / frames, r.getStats().gpuFrameTime);
+         printGLCounters(frames);
+         win->close();
+      }
    }
 
+   //shutdown destroys GL objects, the context has to be back on this thread
+   r.stopRenderThread();
    g.onShutdown();
    Window::destroy(win);
-}
\ No newline at end of file
+}